@@ -1,9 +1,17 @@
+#define _POSIX_C_SOURCE 199309L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <time.h>
 
 #include "a.h"
 
+#if CHKGL_MODE == 1
+const char* chkgl_file = "(start)";
+int chkgl_line;
+#endif
+
 void arghf(const char* fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -12,3 +20,14 @@ void arghf(const char* fmt, ...) {
 	abort();
 }
 
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+float randf(float min, float max)
+{
+	return min + (max - min) * ((float)rand() / (float)RAND_MAX);
+}
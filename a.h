@@ -5,6 +5,11 @@
 
 void arghf(const char* fmt, ...) __attribute__((noreturn)) __attribute__((format (printf, 1, 2)));
 
+// seconds on the monotonic clock, for timing
+double now();
+// uniform in [min;max], from rand()
+float randf(float min, float max);
+
 // general assertions
 #define ASSERT(cond) do { if (!(cond)) { arghf("ASSERT(%s) failed in %s() in %s:%d\n", #cond, __func__, __FILE__, __LINE__); } } while (0)
 #define AN(expr) do { ASSERT((expr) != 0); } while(0)
@@ -15,7 +20,21 @@ void arghf(const char* fmt, ...) __attribute__((noreturn)) __attribute__((format
 #define SAZ(expr) do { SDL_ASSERT((expr) == 0); } while(0)
 #define SAN(expr) do { SDL_ASSERT((expr) != 0); } while(0)
 
-// GL
+// GL; CHKGL_MODE picks the error strategy (see glcheck.h):
+//  0: none; CHKGL compiles to nothing
+//  1: only records where it is, for the debug callback / per-frame check
+//  2: glGetError() after each call (serializes the pipeline on some drivers)
+#ifndef CHKGL_MODE
+#define CHKGL_MODE (2)
+#endif
+#if CHKGL_MODE == 2
 #define CHKGL do { GLenum xx_GLERR = glGetError(); if (xx_GLERR != GL_NO_ERROR) arghf("OPENGL ERROR %d in %s:%d", xx_GLERR, __FILE__, __LINE__); } while (0)
+#elif CHKGL_MODE == 1
+extern const char* chkgl_file;
+extern int chkgl_line;
+#define CHKGL do { chkgl_file = __FILE__; chkgl_line = __LINE__; } while (0)
+#else
+#define CHKGL do {} while (0)
+#endif
 
 #endif/*_A_H_*/
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "a.h"
+#include "m.h"
+#include "sol.h"
+#include "kepler.h"
+#include "world.h"
+#include "orbit.h"
+#include "text.h"
+#include "utf8_decode.h"
+
+/* bench: microbenchmarks of the hot CPU paths. each benchmark is run in
+ * SAMPLES samples of enough repetitions to take ~SAMPLE_S; the median and
+ * p99 are over the samples. inputs are fixed (srand(1)), so runs are
+ * comparable between builds.
+ *
+ *   bench [-m] [substring]
+ *
+ * -m prints tab-separated "name median_ns p99_ns items_per_s" lines for
+ * scripts; a substring only runs benchmarks whose names contain it */
+
+#define SAMPLES (101)
+#define SAMPLE_S (2e-3)
+#define N_INPUTS (1024)
+
+// results go here so the compiler can't drop the work
+static volatile float sink;
+
+static float in_M[N_INPUTS];
+static float in_e[N_INPUTS];
+
+static struct celestial_body* bodies;
+static int n_bodies;
+static struct world world_sol;
+static struct world world_minor;
+
+static struct text text;
+static char utf8_buf[4096];
+static int utf8_len;
+
+/* each function does reps operations of items items each */
+
+static void run_eccentric_anomaly(int reps)
+{
+	float s = 0;
+	for (int r = 0; r < reps; r++) {
+		int i = r & (N_INPUTS-1);
+		s += eccentric_anomaly_from_mean_anomaly(in_M[i], in_e[i], 10);
+	}
+	sink = s;
+}
+
+static void run_kepler_solve(int reps)
+{
+	float s = 0;
+	for (int r = 0; r < reps; r++) {
+		int i = r & (N_INPUTS-1);
+		s += kepler_solve(in_M[i], in_e[i]);
+	}
+	sink = s;
+}
+
+static void run_calc_ellipse_position(int reps)
+{
+	float s = 0;
+	for (int r = 0; r < reps; r++) {
+		int i = r & (N_INPUTS-1);
+		float x, y, nx, ny;
+		calc_ellipse_position(in_M[i], in_e[i], 1.5e8f, 1.4e8f, 0.6f, 0.8f, &x, &y, &nx, &ny);
+		s += x + y + nx + ny;
+	}
+	sink = s;
+}
+
+static void run_world_sol(int reps)
+{
+	for (int r = 0; r < reps; r++) {
+		world_sol.t60 += 100000;
+		world_update_positions(&world_sol);
+	}
+	sink = world_sol.kepler.x[1];
+}
+
+static void run_world_minor(int reps)
+{
+	for (int r = 0; r < reps; r++) {
+		world_minor.t60 += 100000;
+		world_update_positions(&world_minor);
+	}
+	sink = world_minor.kepler.x[1];
+}
+
+static void run_mksol(int reps)
+{
+	for (int r = 0; r < reps; r++) {
+		int n = 0;
+		struct celestial_body* b = mksol(&n);
+		sink = b[n-1].semi_major_axis_km;
+		free(b);
+	}
+}
+
+static const float orbit_color[4] = {0.6, 0.6, 0.6, 0.5};
+
+static void run_orbit_build(int reps)
+{
+	static float vertices[ORBIT_VERTEX_FLOATS];
+	static uint32_t indices[ORBIT_INDICES];
+	for (int r = 0; r < reps; r++) {
+		orbit_build(&bodies[3], orbit_color, 3, vertices);
+		orbit_build_indices(r * ORBIT_VERTICES, indices);
+	}
+	sink = vertices[ORBIT_VERTEX_FLOATS-1] + indices[ORBIT_INDICES-1];
+}
+
+// the orbit of bodies[3] zoomed in on the body (height 3e5 km)
+static void run_orbit_clip(int reps)
+{
+	static float vertices[ORBIT_ARC_MAX_VERTICES * ORBIT_FLOATS_PER_VERTEX];
+	struct orbit_arcs arcs;
+	struct celestial_body* b = &bodies[3];
+	float scale = 1080 / 3e5f;
+	float x, y;
+	calc_ellipse_position(1, b->eccentricity, b->semi_major_axis_km, b->semi_minor_axis_km, b->cos_lop, b->sin_lop, &x, &y, NULL, NULL);
+	int s = 0;
+	for (int r = 0; r < reps; r++) {
+		arcs.n_vertices = 0;
+		arcs.n_runs = 0;
+		orbit_clip(b, orbit_color, 0, -x * scale, -y * scale, scale, 1920, 1080, vertices, &arcs);
+		s += arcs.n_vertices;
+	}
+	sink = s;
+}
+
+static void run_font_find_meta(int reps)
+{
+	int s = 0;
+	for (int r = 0; r < reps; r++) {
+		int* meta = font_find_meta(font_ter24, r & 1, 32 + r % 95);
+		s += meta != NULL ? meta[4] : 0;
+	}
+	sink = s;
+}
+
+static void run_utf8_decode(int reps)
+{
+	int s = 0;
+	for (int r = 0; r < reps; r++) {
+		char* p = utf8_buf;
+		int n = utf8_len;
+		while (n > 0) s += utf8_decode(&p, &n);
+	}
+	sink = s;
+}
+
+static void run_text_printf(int reps)
+{
+	for (int r = 0; r < reps; r++) {
+		text.n_quads = 0;
+		text_set_cursor(&text, 16, 16);
+		text_printf(&text, "%04d-%02d-%02d %02d:%02d:%02d x%g", 2000 + r % 100, 1 + r % 12, 1 + r % 28, r % 24, r % 60, r % 60, 100000.0);
+	}
+	sink = text.vertex_data[0];
+}
+
+struct benchmark {
+	const char* name;
+	void (*run)(int reps);
+	int items; // per op
+};
+
+static int cmp_double(const void* a, const void* b)
+{
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void measure(struct benchmark* bm, int machine)
+{
+	// calibrate repetitions per sample
+	int reps = 1;
+	for (;;) {
+		double t0 = now();
+		bm->run(reps);
+		double dt = now() - t0;
+		if (dt >= SAMPLE_S || reps >= (1<<30)) break;
+		reps *= dt > SAMPLE_S / 16 ? 2 : 8;
+	}
+
+	double ns[SAMPLES];
+	for (int s = 0; s < SAMPLES; s++) {
+		double t0 = now();
+		bm->run(reps);
+		ns[s] = (now() - t0) * 1e9 / reps;
+	}
+	qsort(ns, SAMPLES, sizeof(double), cmp_double);
+	double median = ns[SAMPLES/2];
+	double p99 = ns[(SAMPLES * 99) / 100];
+	double items_per_s = bm->items * 1e9 / median;
+
+	if (machine) {
+		printf("%s\t%.3f\t%.3f\t%.0f\n", bm->name, median, p99, items_per_s);
+	} else {
+		printf("%-28s %12.1f ns %12.1f ns %14.0f items/s\n", bm->name, median, p99, items_per_s);
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+	int machine = 0;
+	const char* filter = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-m") == 0) {
+			machine = 1;
+		} else if (filter == NULL && argv[i][0] != '-') {
+			filter = argv[i];
+		} else {
+			fprintf(stderr, "usage: %s [-m] [substring]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	srand(1);
+	for (int i = 0; i < N_INPUTS; i++) {
+		in_M[i] = randf(-TAU/2, TAU/2);
+		in_e[i] = randf(0, 0.9);
+	}
+
+	bodies = mksol(&n_bodies);
+	world_init(&world_sol, bodies, n_bodies);
+
+	// mksol() must leave earlier arrays alone
+	struct celestial_body* bodies_copy;
+	AN(bodies_copy = malloc(n_bodies * sizeof(struct celestial_body)));
+	memcpy(bodies_copy, bodies, n_bodies * sizeof(struct celestial_body));
+	int n_minor_bodies = 0;
+	struct celestial_body* planets = mksol(&n_minor_bodies);
+	ASSERT(n_minor_bodies == n_bodies);
+	ASSERT(memcmp(bodies, bodies_copy, n_bodies * sizeof(struct celestial_body)) == 0);
+	free(bodies_copy);
+	int first;
+	int n_minor = 100000;
+	struct celestial_body* minor = sol_insert_satellites(planets, &n_minor_bodies, 0, n_minor, CBC_MINOR, &first);
+	free(planets);
+	for (int i = first; i < first + n_minor; i++) {
+		minor[i].renderer = CBR_POINT;
+		celestial_body_set_elements(minor, i, randf(1.8, 5.5) * AU_IN_KM, randf(0, 0.4), randf(0, TAU), randf(0, TAU));
+	}
+	world_init(&world_minor, minor, n_minor_bodies);
+
+	fonts_load();
+	memset(&text, 0, sizeof(text));
+	text.max_quads = 4096;
+	AN(text.vertex_data = malloc(text.max_quads * 4 * 8 * sizeof(float)));
+	text_set_window_dimensions(&text, 1920, 1080);
+	text_set_font(&text, font_ter24);
+	text_set_variant(&text, 1);
+
+	const char* sample = "mercury venus earth \xce\xb1\xce\xb2\xce\xb3 \xe2\x98\x89\xe2\x99\x81 \xf0\x9f\x8c\x8d ";
+	int n_codepoints = 0;
+	while (utf8_len + (int)strlen(sample) < (int)sizeof(utf8_buf)) {
+		memcpy(utf8_buf + utf8_len, sample, strlen(sample));
+		utf8_len += strlen(sample);
+	}
+	{
+		char* p = utf8_buf;
+		int n = utf8_len;
+		while (n > 0) {
+			utf8_decode(&p, &n);
+			n_codepoints++;
+		}
+	}
+
+	struct benchmark benchmarks[] = {
+		{"eccentric_anomaly_10it", run_eccentric_anomaly, 1},
+		{"kepler_solve", run_kepler_solve, 1},
+		{"calc_ellipse_position", run_calc_ellipse_position, 1},
+		{"world_positions_sol", run_world_sol, n_bodies},
+		{"world_positions_100k", run_world_minor, n_minor_bodies},
+		{"mksol", run_mksol, n_bodies},
+		{"orbit_build", run_orbit_build, ORBIT_SEGMENTS + ORBIT_LODS},
+		{"orbit_clip_zoomed", run_orbit_clip, 1},
+		{"font_find_meta", run_font_find_meta, 1},
+		{"utf8_decode_4k", run_utf8_decode, n_codepoints},
+		{"text_printf_hud", run_text_printf, 1},
+	};
+
+	if (machine) printf("name\tmedian_ns\tp99_ns\titems_per_s\n");
+	for (int i = 0; i < (int)(sizeof(benchmarks) / sizeof(benchmarks[0])); i++) {
+		if (filter != NULL && strstr(benchmarks[i].name, filter) == NULL) continue;
+		measure(&benchmarks[i], machine);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,17 +1,28 @@
+@define AA 0 1 3
 @vert
 #version 130
 
 attribute vec2 a_position;
 
+// per instance
+attribute vec3 a_body; // offset (pixels), radius (pixels)
+attribute vec2 a_light;
+attribute vec3 a_color;
+
 varying vec2 v_position;
+varying float v_mu;
+varying vec2 v_light;
+varying vec3 v_color;
 
-uniform vec2 u_offset;
-uniform vec2 u_scale;
+uniform vec2 u_ndc; // pixels to NDC
 
 void main()
 {
 	v_position = a_position;
-	gl_Position = vec4(a_position * u_scale + u_offset, 0, 1);
+	v_mu = 4.0/(a_body.z*6.0);
+	v_light = a_light;
+	v_color = a_color;
+	gl_Position = vec4((a_body.xy + a_position * a_body.z) * u_ndc, 0, 1);
 }
 
 
@@ -19,31 +30,46 @@ void main()
 #version 130
 
 varying vec2 v_position;
-uniform float u_mu;
-uniform vec2 u_light;
-uniform vec3 u_color;
+varying float v_mu;
+varying vec2 v_light;
+varying vec3 v_color;
 
-void main(void)
+/* AA is the supersampling radius, for (2AA+1)^2 samples per fragment, or
+ * 0 for one sample with its edges ramped over the 7x7 footprint. all tiers
+ * keep the original 7x7 normalisation, sum/36, i.e. a GAIN of 49/36 */
+const float GAIN = 49.0/36.0;
+const float FOOTPRINT = 7.0; // in units of mu
+const float ambient = 0.06;
+
+vec3 lit(vec2 spos, float r)
 {
-	const float N = 3;
-	vec4 color = vec4(0,0,0,0);
 	float tau = 1.5707963267948966;
-	float ambient = 0.06;
 	float bright = 1 - ambient;
+	vec3 lvec = vec3(v_light, 0);
+	vec3 svec = vec3(normalize(spos) * sin(r*tau), cos(r*tau));
+	float d = dot(lvec, svec);
+	float x = d < 0 ? ambient : ambient + d * bright;
+	return v_color*x;
+}
+
+void main(void)
+{
+#if AA == 0
+	float r = length(v_position);
+	float coverage = clamp((0.98 - r) / (FOOTPRINT * v_mu) + 0.5, 0, 1);
+	gl_FragColor = vec4(lit(v_position, min(r, 0.98)), 1) * (coverage * GAIN);
+#else
+	const float N = AA;
+	vec4 color = vec4(0,0,0,0);
 	for (float dy = -N; dy <= N; dy++) {
 		for (float dx = -N; dx <= N; dx++) {
-			vec2 spos = v_position + vec2(dx*u_mu,dy*u_mu);
+			vec2 spos = v_position + vec2(dx*v_mu,dy*v_mu);
 			float r = length(spos);
 			if (r < 0.98) {
-				vec3 lvec = vec3(u_light, 0);
-				vec3 svec = vec3(normalize(spos) * sin(r*tau), cos(r*tau));
-				float d = dot(lvec, svec);
-				float x = d < 0 ? ambient : ambient + d * bright;
-				color += vec4(u_color*x,1);
+				color += vec4(lit(spos, r),1);
 			}
 		}
 	}
-	gl_FragColor = color / float(N*N*4);
+	gl_FragColor = color * (GAIN / ((2*N+1)*(2*N+1)));
+#endif
 }
-
-
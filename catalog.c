@@ -0,0 +1,141 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "a.h"
+#include "mud.h"
+#include "sol.h"
+#include "catalog.h"
+
+static const char catalog_magic[8] = "YOCATLG";
+
+#define ALIGN (64)
+
+static uint64_t align(uint64_t x)
+{
+	return (x + ALIGN - 1) & ~(uint64_t)(ALIGN - 1);
+}
+
+static void write_or_die(FILE* f, const void* data, size_t n, const char* path)
+{
+	if (n > 0 && fwrite(data, n, 1, f) != 1) arghf("%s: write error", path);
+}
+
+static void pad_to(FILE* f, uint64_t* pos, uint64_t to, const char* path)
+{
+	static const char zeros[ALIGN];
+	ASSERT(to >= *pos && to - *pos <= ALIGN);
+	write_or_die(f, zeros, to - *pos, path);
+	*pos = to;
+}
+
+void catalog_write(const char* path, struct celestial_body* bodies, int n_bodies)
+{
+	// "" first, for unnamed bodies, like sol_names
+	uint64_t strings_size = 1;
+	for (int i = 0; i < n_bodies; i++) {
+		const char* name = celestial_body_name(&bodies[i]);
+		if (name[0] != 0) strings_size += strlen(name) + 1;
+	}
+	if (strings_size > UINT32_MAX) arghf("%s: too many names", path);
+
+	struct catalog_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, catalog_magic, sizeof(h.magic));
+	h.version = CATALOG_VERSION;
+	h.body_size = sizeof(struct celestial_body);
+	h.n_bodies = n_bodies;
+	h.bodies_offset = align(sizeof(h));
+	h.strings_offset = align(h.bodies_offset + (uint64_t)n_bodies * sizeof(struct celestial_body));
+	h.strings_size = strings_size;
+
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) arghf("%s: %s", path, strerror(errno));
+
+	uint64_t pos = 0;
+	write_or_die(f, &h, sizeof(h), path);
+	pos += sizeof(h);
+	pad_to(f, &pos, h.bodies_offset, path);
+
+	uint32_t name = 1;
+	for (int i = 0; i < n_bodies; i++) {
+		struct celestial_body b = bodies[i];
+		const char* s = celestial_body_name(&bodies[i]);
+		b.name = s[0] != 0 ? name : 0;
+		if (s[0] != 0) name += strlen(s) + 1;
+		write_or_die(f, &b, sizeof(b), path);
+	}
+	pos += (uint64_t)n_bodies * sizeof(struct celestial_body);
+	pad_to(f, &pos, h.strings_offset, path);
+
+	write_or_die(f, "", 1, path);
+	for (int i = 0; i < n_bodies; i++) {
+		const char* s = celestial_body_name(&bodies[i]);
+		if (s[0] != 0) write_or_die(f, s, strlen(s) + 1, path);
+	}
+
+	if (fclose(f) != 0) arghf("%s: %s", path, strerror(errno));
+}
+
+struct celestial_body* catalog_map(const char* path, int* n_bodiesp)
+{
+	int fd = mud_open(path);
+	struct stat st;
+	if (fstat(fd, &st) == -1) arghf("fstat(%s): %s", path, strerror(errno));
+	uint64_t size = st.st_size;
+
+	struct catalog_header h;
+	if (size < sizeof(h)) {
+		mud_close(fd);
+		return NULL;
+	}
+	mud_readn(fd, &h, sizeof(h));
+	if (memcmp(h.magic, catalog_magic, sizeof(h.magic)) != 0 || h.version != CATALOG_VERSION || h.body_size != sizeof(struct celestial_body)) {
+		mud_close(fd);
+		return NULL;
+	}
+	if (h.n_bodies == 0 ||
+		h.bodies_offset + (uint64_t)h.n_bodies * h.body_size > h.strings_offset ||
+		h.strings_offset + h.strings_size > size) {
+		arghf("%s: truncated or corrupt catalog", path);
+	}
+
+	/* read-only mapping: pages are read in by faults as they are touched,
+	 * and bodies are never written (changes go through
+	 * sol_insert_satellites(), which copies) */
+	char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) arghf("mmap(%s): %s", path, strerror(errno));
+	mud_close(fd);
+
+	struct celestial_body* bodies = (struct celestial_body*)(data + h.bodies_offset);
+	const char* strings = data + h.strings_offset;
+	if (h.strings_size == 0 || strings[0] != 0 || strings[h.strings_size - 1] != 0) {
+		arghf("%s: corrupt catalog string table", path);
+	}
+	for (int i = 0; i < h.n_bodies; i++) {
+		if (bodies[i].name >= h.strings_size) arghf("%s: corrupt catalog string table", path);
+	}
+
+	if (!sol_names_map(strings, h.strings_size)) {
+		// names exist already; ours go after them, in a copy of the bodies
+		uint32_t base;
+		char* names = sol_names_reserve(h.strings_size, &base);
+		memcpy(names, strings, h.strings_size);
+		struct celestial_body* copy;
+		AN(copy = malloc(h.n_bodies * sizeof(struct celestial_body)));
+		memcpy(copy, bodies, h.n_bodies * sizeof(struct celestial_body));
+		for (int i = 0; i < h.n_bodies; i++) {
+			if (copy[i].name != 0) copy[i].name += base;
+		}
+		bodies = copy;
+	}
+
+	sol_elements_generation++;
+	*n_bodiesp = h.n_bodies;
+	return bodies;
+}
@@ -0,0 +1,44 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdint.h>
+
+#include "sol.h"
+
+/* binary body catalog; mmap'd and used in place.
+
+   layout (host byte order; offsets are from the start of the file):
+     struct catalog_header
+     struct celestial_body[n_bodies] at bodies_offset, breadth-first, with
+       parent/first_satellite/n_satellites as written by mksol() and the
+       derived elements already computed; name is an offset into the
+       string table
+     NUL-terminated names at strings_offset, starting with "" (offset 0)
+
+   the string table becomes sol_names in place, so neither table is copied
+
+   the body table is an image of struct celestial_body, so a catalog is
+   rejected if body_size differs; bump CATALOG_VERSION when the struct
+   changes in a way that keeps its size */
+
+#define CATALOG_VERSION (3)
+
+struct catalog_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t body_size;
+	uint32_t n_bodies;
+	uint32_t reserved;
+	uint64_t bodies_offset;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+};
+
+void catalog_write(const char* path, struct celestial_body* bodies, int n_bodies);
+
+// returns the body array (mapped read-only) or NULL if path is not a
+// catalog of this version. if there are names already (see sol_names_map()),
+// the bodies are copied instead
+struct celestial_body* catalog_map(const char* path, int* n_bodiesp);
+
+#endif/*CATALOG_H*/
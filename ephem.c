@@ -0,0 +1,328 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "a.h"
+#include "m.h"
+#include "kepler.h"
+#include "ephem.h"
+
+#define EPHEM_N (EPHEM_DEGREE + 1)
+
+// file format version; bump when the layout or fitting changes
+#define EPHEM_FILE_VERSION (1)
+static const char ephem_magic[8] = "YOEPHEM";
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t n)
+{
+	const unsigned char* p = data;
+	for (size_t i = 0; i < n; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static void ephem_sync_elements(struct ephem* ephem)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	int params[] = {EPHEM_DEGREE, EPHEM_WINDOWS_PER_ORBIT, ephem->n};
+	h = fnv1a(h, params, sizeof(params));
+	for (int i = 0; i < ephem->n; i++) {
+		struct celestial_body* body = &ephem->bodies[i];
+		double mm = body->mean_motion_rad_s;
+		ephem->window_s[i] = mm > 0 ? (TAU / mm) / EPHEM_WINDOWS_PER_ORBIT : 0;
+		ephem->inv_window_s[i] = mm > 0 ? 1.0 / ephem->window_s[i] : 0;
+
+		float el[] = {body->semi_major_axis_km, body->eccentricity, body->longitude_of_periapsis_rad, body->mean_longitude_j2000_rad};
+		h = fnv1a(h, el, sizeof(el));
+		h = fnv1a(h, &mm, sizeof(mm));
+	}
+	ephem->elements_hash = h;
+	ephem->generation = sol_elements_generation;
+}
+
+// Chebyshev nodes in [-1;1] and T_j at the nodes; see ephem_fit()
+static double cheb_node[EPHEM_N];
+static double cheb_T[EPHEM_N][EPHEM_N];
+
+static void cheb_init()
+{
+	for (int k = 0; k < EPHEM_N; k++) {
+		cheb_node[k] = cos((TAU/2) * (k + 0.5) / EPHEM_N);
+		for (int j = 0; j < EPHEM_N; j++) {
+			cheb_T[j][k] = cos((TAU/2) * j * (k + 0.5) / EPHEM_N);
+		}
+	}
+}
+
+void ephem_init(struct ephem* ephem, struct celestial_body* bodies, int n, size_t max_bytes)
+{
+	memset(ephem, 0, sizeof(*ephem));
+	cheb_init();
+	ephem->bodies = bodies;
+	ephem->n = n;
+
+	AN(ephem->parent = calloc(n, sizeof(int)));
+	AN(ephem->window_s = calloc(n, sizeof(double)));
+	AN(ephem->inv_window_s = calloc(n, sizeof(double)));
+	AN(ephem->current = calloc(n, sizeof(int)));
+	for (int i = 0; i < n; i++) {
+		ephem->parent[i] = bodies[i].parent;
+		ASSERT(ephem->parent[i] < i); // breadth-first order
+	}
+
+	ephem->max_entries = max_bytes / sizeof(struct ephem_entry);
+	ASSERT(ephem->max_entries > 0);
+	AN(ephem->entries = calloc(ephem->max_entries, sizeof(struct ephem_entry)));
+	ephem->n_buckets = 1;
+	while (ephem->n_buckets < ephem->max_entries * 2) ephem->n_buckets <<= 1;
+	AN(ephem->buckets = malloc(ephem->n_buckets * sizeof(int)));
+
+	ephem_sync_elements(ephem);
+	ephem_clear(ephem);
+}
+
+void ephem_free(struct ephem* ephem)
+{
+	free(ephem->parent);
+	free(ephem->window_s);
+	free(ephem->inv_window_s);
+	free(ephem->current);
+	free(ephem->entries);
+	free(ephem->buckets);
+	memset(ephem, 0, sizeof(*ephem));
+}
+
+void ephem_clear(struct ephem* ephem)
+{
+	ephem->n_entries = 0;
+	ephem->clock_hand = 0;
+	for (int i = 0; i < ephem->n_buckets; i++) ephem->buckets[i] = -1;
+	for (int i = 0; i < ephem->n; i++) ephem->current[i] = -1;
+}
+
+static inline int bucket_of(struct ephem* ephem, int body, int64_t window)
+{
+	uint64_t h = (uint64_t)body * 0x9e3779b97f4a7c15ULL ^ (uint64_t)window * 0xc2b2ae3d27d4eb4fULL;
+	h ^= h >> 29;
+	return h & (ephem->n_buckets - 1);
+}
+
+// returns a free entry, evicting one if full
+static int ephem_alloc(struct ephem* ephem)
+{
+	if (ephem->n_entries < ephem->max_entries) return ephem->n_entries++;
+
+	int idx;
+	for (;;) {
+		idx = ephem->clock_hand;
+		ephem->clock_hand = (ephem->clock_hand + 1) % ephem->max_entries;
+		if (!ephem->entries[idx].referenced) break;
+		ephem->entries[idx].referenced = 0;
+	}
+
+	struct ephem_entry* en = &ephem->entries[idx];
+	int* p = &ephem->buckets[bucket_of(ephem, en->body, en->window)];
+	while (*p != idx) {
+		ASSERT(*p >= 0);
+		p = &ephem->entries[*p].hash_next;
+	}
+	*p = en->hash_next;
+	if (ephem->current[en->body] == idx) ephem->current[en->body] = -1;
+	return idx;
+}
+
+static void ephem_insert(struct ephem* ephem, int idx)
+{
+	struct ephem_entry* en = &ephem->entries[idx];
+	int* bucket = &ephem->buckets[bucket_of(ephem, en->body, en->window)];
+	en->hash_next = *bucket;
+	en->referenced = 1;
+	*bucket = idx;
+}
+
+static void relative_position(struct celestial_body* body, double t, double* x, double* y)
+{
+	double e = body->eccentricity;
+	double M = body->M0_rad + fmod(body->mean_motion_rad_s * t, TAU);
+	double E = kepler_solve_double(M, e);
+	double Ex = (cos(E) - e) * body->semi_major_axis_km;
+	double Ey = sin(E) * body->semi_minor_axis_km;
+	*x = body->cos_lop * Ex - body->sin_lop * Ey;
+	*y = body->sin_lop * Ex + body->cos_lop * Ey;
+}
+
+// Chebyshev interpolation at the EPHEM_N Chebyshev nodes of the window
+static void ephem_fit(struct ephem* ephem, struct ephem_entry* en)
+{
+	struct celestial_body* body = &ephem->bodies[en->body];
+	double W = ephem->window_s[en->body];
+	double t0 = (double)en->window * W;
+
+	double fx[EPHEM_N], fy[EPHEM_N];
+	for (int k = 0; k < EPHEM_N; k++) {
+		relative_position(body, t0 + (cheb_node[k] + 1) * 0.5 * W, &fx[k], &fy[k]);
+	}
+
+	for (int j = 0; j < EPHEM_N; j++) {
+		double sx = 0;
+		double sy = 0;
+		for (int k = 0; k < EPHEM_N; k++) {
+			sx += fx[k] * cheb_T[j][k];
+			sy += fy[k] * cheb_T[j][k];
+		}
+		double norm = (j == 0 ? 1.0 : 2.0) / EPHEM_N;
+		en->cx[j] = sx * norm;
+		en->cy[j] = sy * norm;
+	}
+}
+
+static int ephem_get(struct ephem* ephem, int body, int64_t window)
+{
+	int idx = ephem->current[body];
+	if (idx >= 0 && ephem->entries[idx].window == window) {
+		ephem->hits++;
+		ephem->entries[idx].referenced = 1;
+		return idx;
+	}
+
+	for (idx = ephem->buckets[bucket_of(ephem, body, window)]; idx >= 0; idx = ephem->entries[idx].hash_next) {
+		struct ephem_entry* en = &ephem->entries[idx];
+		if (en->body == body && en->window == window) {
+			ephem->hits++;
+			en->referenced = 1;
+			ephem->current[body] = idx;
+			return idx;
+		}
+	}
+
+	ephem->misses++;
+	idx = ephem_alloc(ephem);
+	struct ephem_entry* en = &ephem->entries[idx];
+	en->body = body;
+	en->window = window;
+	ephem_fit(ephem, en);
+	ephem_insert(ephem, idx);
+	ephem->current[body] = idx;
+	return idx;
+}
+
+static inline float clenshaw(const float* c, float u)
+{
+	float b1 = 0;
+	float b2 = 0;
+	for (int j = EPHEM_N - 1; j >= 1; j--) {
+		float b0 = 2*u*b1 - b2 + c[j];
+		b2 = b1;
+		b1 = b0;
+	}
+	return u*b1 - b2 + c[0];
+}
+
+void ephem_propagate(struct ephem* ephem, double t, float* x, float* y)
+{
+	if (ephem->generation != sol_elements_generation) {
+		ephem_sync_elements(ephem);
+		ephem_clear(ephem);
+	}
+
+	x[0] = 0;
+	y[0] = 0;
+	for (int i = 1; i < ephem->n; i++) {
+		double tw = t * ephem->inv_window_s[i];
+		double w = floor(tw);
+		struct ephem_entry* en = &ephem->entries[ephem_get(ephem, i, (int64_t)w)];
+		float u = (float)(2.0 * (tw - w) - 1.0);
+		int p = ephem->parent[i];
+		x[i] = x[p] + clenshaw(en->cx, u);
+		y[i] = y[p] + clenshaw(en->cy, u);
+	}
+}
+
+/* file layout (host byte order):
+ *   char magic[8], uint32 version, uint32 degree, uint32 n_bodies,
+ *   uint64 elements_hash, uint32 n_entries,
+ *   then n_entries x {int32 body, int64 window, float cx[], float cy[]} */
+
+void ephem_save(struct ephem* ephem, const char* path)
+{
+	FILE* f = fopen(path, "wb");
+	if (f == NULL) {
+		perror(path);
+		return;
+	}
+
+	uint32_t header[] = {EPHEM_FILE_VERSION, EPHEM_DEGREE, ephem->n};
+	uint32_t n_entries = ephem->n_entries;
+	fwrite(ephem_magic, sizeof(ephem_magic), 1, f);
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(&ephem->elements_hash, sizeof(ephem->elements_hash), 1, f);
+	fwrite(&n_entries, sizeof(n_entries), 1, f);
+
+	for (int idx = 0; idx < ephem->n_entries; idx++) {
+		struct ephem_entry* en = &ephem->entries[idx];
+		int32_t body = en->body;
+		int64_t window = en->window;
+		fwrite(&body, sizeof(body), 1, f);
+		fwrite(&window, sizeof(window), 1, f);
+		fwrite(en->cx, sizeof(en->cx), 1, f);
+		fwrite(en->cy, sizeof(en->cy), 1, f);
+	}
+
+	if (ferror(f)) fprintf(stderr, "%s: write error\n", path);
+	fclose(f);
+}
+
+int ephem_load(struct ephem* ephem, const char* path)
+{
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) return 0;
+
+	if (ephem->generation != sol_elements_generation) ephem_sync_elements(ephem);
+	ephem_clear(ephem);
+
+	char magic[8];
+	uint32_t header[3];
+	uint64_t elements_hash;
+	uint32_t n_entries;
+	int ok =
+		fread(magic, sizeof(magic), 1, f) == 1 &&
+		fread(header, sizeof(header), 1, f) == 1 &&
+		fread(&elements_hash, sizeof(elements_hash), 1, f) == 1 &&
+		fread(&n_entries, sizeof(n_entries), 1, f) == 1 &&
+		memcmp(magic, ephem_magic, sizeof(magic)) == 0 &&
+		header[0] == EPHEM_FILE_VERSION &&
+		header[1] == EPHEM_DEGREE &&
+		header[2] == ephem->n &&
+		elements_hash == ephem->elements_hash;
+
+	for (uint32_t i = 0; ok && i < n_entries; i++) {
+		int32_t body;
+		int64_t window;
+		struct ephem_entry tmp;
+		ok =
+			fread(&body, sizeof(body), 1, f) == 1 &&
+			fread(&window, sizeof(window), 1, f) == 1 &&
+			fread(tmp.cx, sizeof(tmp.cx), 1, f) == 1 &&
+			fread(tmp.cy, sizeof(tmp.cy), 1, f) == 1 &&
+			body > 0 && body < ephem->n;
+		if (!ok) break;
+
+		int idx = ephem_alloc(ephem);
+		struct ephem_entry* en = &ephem->entries[idx];
+		en->body = body;
+		en->window = window;
+		memcpy(en->cx, tmp.cx, sizeof(en->cx));
+		memcpy(en->cy, tmp.cy, sizeof(en->cy));
+		ephem_insert(ephem, idx);
+	}
+
+	fclose(f);
+	if (!ok) {
+		fprintf(stderr, "%s: stale or corrupt ephemeris cache; ignored\n", path);
+		ephem_clear(ephem);
+	}
+	return ok;
+}
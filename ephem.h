@@ -0,0 +1,60 @@
+#ifndef EPHEM_H
+#define EPHEM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sol.h"
+
+/* ephemeris cache: each body's position relative to its parent is fitted
+ * with a Chebyshev polynomial per time window (1/EPHEM_WINDOWS_PER_ORBIT of
+ * its orbital period). windows are fitted on first visit; once max_bytes is
+ * reached, windows not used since the last sweep are evicted first (clock
+ * approximation of LRU, so a hit is a single store) */
+
+#define EPHEM_DEGREE (8)
+#define EPHEM_WINDOWS_PER_ORBIT (16)
+
+struct ephem_entry {
+	int body;
+	int64_t window;
+	int hash_next;
+	int referenced;
+	float cx[EPHEM_DEGREE + 1];
+	float cy[EPHEM_DEGREE + 1];
+};
+
+struct ephem {
+	struct celestial_body* bodies;
+	int n;
+	int* parent;
+	double* window_s; // window length per body; 0 for the root
+	double* inv_window_s;
+	int* current; // entry used last time per body, or -1
+
+	int max_entries;
+	int n_entries;
+	struct ephem_entry* entries;
+	int clock_hand;
+	int n_buckets; // power of two
+	int* buckets;
+
+	uint64_t elements_hash;
+	int generation;
+
+	int64_t hits;
+	int64_t misses;
+};
+
+void ephem_init(struct ephem* ephem, struct celestial_body* bodies, int n, size_t max_bytes);
+void ephem_free(struct ephem* ephem);
+void ephem_clear(struct ephem* ephem);
+
+// absolute positions at time t (seconds) into x[n] and y[n]
+void ephem_propagate(struct ephem* ephem, double t, float* x, float* y);
+
+// returns 0 if the file is missing or was made from different elements
+int ephem_load(struct ephem* ephem, const char* path);
+void ephem_save(struct ephem* ephem, const char* path);
+
+#endif/*EPHEM_H*/
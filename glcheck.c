@@ -0,0 +1,59 @@
+#include <stdio.h>
+
+#include <SDL.h>
+#include <GL/glew.h>
+
+#include "a.h"
+#include "glcheck.h"
+
+#if CHKGL_MODE == 1
+
+static int have_callback;
+
+static void GLAPIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* usr)
+{
+	if (type == GL_DEBUG_TYPE_ERROR) {
+		arghf("OPENGL ERROR %s (in the first GL call after %s:%d)", message, chkgl_file, chkgl_line);
+	}
+	if (severity == GL_DEBUG_SEVERITY_HIGH || severity == GL_DEBUG_SEVERITY_MEDIUM) {
+		fprintf(stderr, "OPENGL: %s (after %s:%d)\n", message, chkgl_file, chkgl_line);
+	}
+}
+
+void glcheck_context_attributes()
+{
+	// drivers need not produce debug output for other contexts
+	SAZ(SDL_GL_SetAttribute(SDL_GL_CONTEXT_FLAGS, SDL_GL_CONTEXT_DEBUG_FLAG));
+}
+
+void glcheck_init()
+{
+	// glewInit() may leave an error behind
+	while (glGetError() != GL_NO_ERROR) {}
+
+	if (GLEW_KHR_debug) {
+		glEnable(GL_DEBUG_OUTPUT);
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+		glDebugMessageCallback(callback, NULL);
+		have_callback = 1;
+	} else if (GLEW_ARB_debug_output) {
+		glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB);
+		glDebugMessageCallbackARB(callback, NULL);
+		have_callback = 1;
+	}
+}
+
+void glcheck_frame()
+{
+	if (have_callback) return;
+	GLenum err = glGetError();
+	if (err != GL_NO_ERROR) arghf("OPENGL ERROR %d during the frame (last CHKGL at %s:%d)", err, chkgl_file, chkgl_line);
+}
+
+#else
+
+void glcheck_context_attributes() {}
+void glcheck_init() {}
+void glcheck_frame() {}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef GLCHECK_H
+#define GLCHECK_H
+
+/* GL error reporting for CHKGL_MODE 1 (see a.h): errors come from a
+ * KHR_debug or ARB_debug_output callback, made synchronous so it fires
+ * inside the failing call, right after the last CHKGL passed. without
+ * either extension, glcheck_frame() polls glGetError() once per frame. in
+ * the other modes these do nothing */
+
+// before creating the GL context
+void glcheck_context_attributes();
+// after glewInit()
+void glcheck_init();
+// once per frame
+void glcheck_frame();
+
+#endif/*GLCHECK_H*/
@@ -2,6 +2,13 @@
 use strict;
 use warnings;
 
+# [name].glsl -> [name].glsl.inc, with the @vert and @frag sections as
+# ${name}_vert_src and ${name}_frag_src. lines like
+#   @define AA 0 1 3
+# declare permutations: each permutation is compiled with one of the values
+# #define'd after the #version line (see shader_permutations in shader.h),
+# and a struct shader_source ${name}_source describes them
+
 my $usage = "usage: $0 <[name].glsl>\n";
 
 $ARGV[0] or die($usage);
@@ -13,9 +20,11 @@ my $name = $1;
 -e $filename or die("no such file: $filename\n");
 
 my $out = "";
+my @define_names = ();
+my @define_values = ();
 
 for my $type ("vert", "frag") {
-	$out .= "static const char* ${name}_${type}_src =\n";
+	$out .= "static const char ${name}_${type}_src[] =\n";
 
 	my $current_type = "";
 	my $found = 0;
@@ -23,7 +32,12 @@ for my $type ("vert", "frag") {
 	open IN, $filename;
 	while (<IN>) {
 		chop;
-		if (/^@(.*)$/) {
+		if (/^\@define\s/) {
+			next if $type ne "vert";
+			/^\@define\s+([A-Za-z_][A-Za-z0-9_]*)((\s+-?[0-9]+)+)\s*$/ or die("$filename: bad \@define: $_\n");
+			push @define_names, $1;
+			push @define_values, [split(' ', $2)];
+		} elsif (/^@(.*)$/) {
 			$current_type = $1;
 		} elsif ($current_type eq $type) {
 			$out .= "\t\"$_\\n\"\n";
@@ -36,6 +50,21 @@ for my $type ("vert", "frag") {
 	die("$filename: found no \@$type section\n") if !$found;
 }
 
+if (@define_names) {
+	my $n = scalar(@define_names);
+	$out .= "static const char* const ${name}_define_names[] = {" . join(", ", map { "\"$_\"" } @define_names) . "};\n";
+	$out .= "static const int ${name}_define_n_values[] = {" . join(", ", map { scalar(@$_) } @define_values) . "};\n";
+	$out .= "static const int ${name}_define_values[] = {" . join(", ", map { @$_ } @define_values) . "};\n";
+	$out .= "static const struct shader_source ${name}_source = {\n";
+	$out .= "\t\"$filename\",\n";
+	$out .= "\t${name}_vert_src,\n";
+	$out .= "\t${name}_frag_src,\n";
+	$out .= "\t$n,\n";
+	$out .= "\t${name}_define_names,\n";
+	$out .= "\t${name}_define_n_values,\n";
+	$out .= "\t${name}_define_values,\n";
+	$out .= "};\n";
+}
 
 open OUT, ">$filename.inc";
 print OUT $out;
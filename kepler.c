@@ -0,0 +1,823 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define KEPLER_X86
+#include <immintrin.h>
+#endif
+
+#include "a.h"
+#include "m.h"
+#include "kepler.h"
+#include "pool.h"
+#include "trace.h"
+
+/* the fixed-point iteration converges linearly with rate e, which is slow
+ * (and can stop short) for high eccentricities. kepler_solve() starts from a
+ * decent guess and takes Halley steps until the correction drops below
+ * KEPLER_TOLERANCE; near-circular orbits are done after one step, e=0.99
+ * takes about four */
+#define KEPLER_TOLERANCE (1e-6f)
+#define KEPLER_MAX_ITERATIONS (8)
+// a warm-start guess whose Newton correction exceeds this (radians) is discarded
+#define KEPLER_WARM_THRESHOLD (0.3f)
+
+float eccentric_anomaly_from_mean_anomaly(float M, float eccentricity, int iterations)
+{
+	float E = M;
+	for (int i = 0; i < iterations; i++) {
+		E = M + eccentricity * sinf(E);
+	}
+	return E;
+}
+
+static inline float wrap_pi(float M)
+{
+	return M - TAU * floorf(M * (1.0f/TAU) + 0.5f);
+}
+
+// M+e*sin(M) is good for small e; Danby's M+0.85e is robust near e=1
+static inline float kepler_guess(float M, float e)
+{
+	float s = sinf(M);
+	if (e < 0.8f) return M + e * s;
+	return M + 0.85f * e * (s < 0 ? -1.0f : 1.0f);
+}
+
+static inline float kepler_halley(float M, float e, float E)
+{
+	for (int i = 0; i < KEPLER_MAX_ITERATIONS; i++) {
+		float s = sinf(E);
+		float c = cosf(E);
+		float f = E - e*s - M;
+		float f1 = 1 - e*c;
+		float dE = f / (f1 - 0.5f * f * e*s / f1);
+		E -= dE;
+		if (fabsf(dE) < KEPLER_TOLERANCE) break;
+	}
+	return E;
+}
+
+float kepler_solve(float M, float e)
+{
+	M = wrap_pi(M);
+	return kepler_halley(M, e, kepler_guess(M, e));
+}
+
+float kepler_solve_warm(float M, float e, float E)
+{
+	M = wrap_pi(M);
+
+	// the guess is only trusted if the Newton correction it implies is
+	// small; otherwise (e.g. M wrapped around) start over
+	float s = sinf(E);
+	float c = cosf(E);
+	float f = E - e*s - M;
+	float f1 = 1 - e*c;
+	if (!(fabsf(f) < KEPLER_WARM_THRESHOLD * f1)) return kepler_halley(M, e, kepler_guess(M, e));
+
+	// first Halley step reuses s and c
+	float dE = f / (f1 - 0.5f * f * e*s / f1);
+	E -= dE;
+	if (fabsf(dE) < KEPLER_TOLERANCE) return E;
+	return kepler_halley(M, e, E);
+}
+
+/* E(M,e)-M tabulated for M in [0;pi] and e in [0;KEPLER_TABLE_E_MAX]
+ * (E(-M) = -E(M)). a bilinear lookup is within ~1e-3 rad of the solution,
+ * and a single Halley step from there is as good as kepler_solve() */
+#define TABLE_NM (256)
+#define TABLE_NE (64)
+#define TABLE_STRIDE (TABLE_NM + 1)
+
+static float table[(TABLE_NE + 1) * TABLE_STRIDE];
+static int table_ready;
+
+// M in [0;pi]
+static double solve_double(double M, double e)
+{
+	double lo = M;
+	double hi = M + e;
+	double E = (lo + hi) / 2;
+	for (int i = 0; i < 100; i++) {
+		double f = E - e*sin(E) - M;
+		if (f > 0) hi = E; else lo = E;
+		double En = E - f / (1 - e*cos(E));
+		if (En <= lo || En >= hi) En = (lo + hi) / 2;
+		if (fabs(En - E) < 1e-15) return En;
+		E = En;
+	}
+	return E;
+}
+
+double kepler_solve_double(double M, double e)
+{
+	M -= TAU * floor(M / TAU + 0.5);
+	return M < 0 ? -solve_double(-M, e) : solve_double(M, e);
+}
+
+void kepler_table_init()
+{
+	if (table_ready) return;
+	for (int ie = 0; ie <= TABLE_NE; ie++) {
+		double e = (double)ie / TABLE_NE * KEPLER_TABLE_E_MAX;
+		for (int im = 0; im <= TABLE_NM; im++) {
+			double M = (double)im / TABLE_NM * (TAU/2);
+			table[ie * TABLE_STRIDE + im] = solve_double(M, e) - M;
+		}
+	}
+	table_ready = 1;
+}
+
+static inline float table_lookup(float Mabs, float e)
+{
+	float fm = Mabs * (float)(TABLE_NM / (TAU/2));
+	float fe = e * (float)(TABLE_NE / KEPLER_TABLE_E_MAX);
+	int im = (int)fm;
+	int ie = (int)fe;
+	if (im > TABLE_NM-1) im = TABLE_NM-1;
+	if (ie > TABLE_NE-1) ie = TABLE_NE-1;
+	float tm = fm - im;
+	float te = fe - ie;
+	const float* p = &table[ie * TABLE_STRIDE + im];
+	float d0 = p[0] + (p[1] - p[0]) * tm;
+	float d1 = p[TABLE_STRIDE] + (p[TABLE_STRIDE+1] - p[TABLE_STRIDE]) * tm;
+	return Mabs + d0 + (d1 - d0) * te;
+}
+
+float kepler_solve_table(float M, float e)
+{
+	if (!(e <= KEPLER_TABLE_E_MAX)) return kepler_solve(M, e);
+	kepler_table_init();
+	M = wrap_pi(M);
+	float E = table_lookup(fabsf(M), e);
+	if (M < 0) E = -E;
+	float s = sinf(E);
+	float c = cosf(E);
+	float f = E - e*s - M;
+	float f1 = 1 - e*c;
+	return E - f / (f1 - 0.5f * f * e*s / f1);
+}
+
+float mean_anomaly_from_eccentric_anomaly(float E, float eccentricity)
+{
+	return E - eccentricity * sinf(E);
+}
+
+void calc_ellipse_position(
+	float eccentric_anomaly,
+	float eccentricity,
+	float semi_major_axis,
+	float semi_minor_axis,
+	float cos_lop,
+	float sin_lop,
+	float* x,
+	float* y,
+	float* nx,
+	float* ny)
+{
+	float Bx = cos_lop;
+	float By = sin_lop;
+
+	float cE = cosf(eccentric_anomaly);
+	float sE = sinf(eccentric_anomaly);
+
+	float Ex = (cE - eccentricity) * semi_major_axis;
+	float Ey = sE * semi_minor_axis;
+	if (x != NULL) *x = Bx * Ex - By * Ey;
+	if (y != NULL) *y = By * Ex + Bx * Ey;
+
+	float Nx = cE * semi_minor_axis;
+	float Ny = sE * semi_major_axis;
+	if (nx != NULL) *nx = Bx * Nx - By * Ny;
+	if (ny != NULL) *ny = By * Nx + Bx * Ny;
+}
+
+void kepler_calc_relative_position(struct celestial_body* body, struct celestial_body* parent, float t, float* dx, float* dy)
+{
+	float e = body->eccentricity;
+	float M = body->M0_rad + fmod(body->mean_motion_rad_s * t, TAU);
+	float E = kepler_solve(M, e);
+	calc_ellipse_position(E, e, body->semi_major_axis_km, body->semi_minor_axis_km, body->cos_lop, body->sin_lop, dx, dy, NULL, NULL);
+}
+
+
+/* batch kernels; each computes positions relative to the parent for bodies
+ * [i0;i1), where i1-i0 is a multiple of KEPLER_BATCH_PAD */
+
+typedef void (*kepler_kernel)(struct kepler_batch* kb, int i0, int i1, double t);
+
+static void kernel_scalar(struct kepler_batch* kb, int i0, int i1, double t)
+{
+	for (int i = i0; i < i1; i++) {
+		double r = kb->M0[i] + kb->mean_motion[i] * t;
+		float M = (float)((r - floor(r + 0.5)) * TAU);
+		float e = kb->e[i];
+		float E = kb->warm_start ? kepler_solve_warm(M, e, kb->E[i]) : kepler_solve(M, e);
+		kb->E[i] = E;
+		float Ex = (cosf(E) - e) * kb->a[i];
+		float Ey = sinf(E) * kb->b[i];
+		kb->x[i] = kb->cos_lop[i] * Ex - kb->sin_lop[i] * Ey;
+		kb->y[i] = kb->sin_lop[i] * Ex + kb->cos_lop[i] * Ey;
+	}
+}
+
+/* the table kernels do the single Halley step without another sin/cos: the
+ * step dE is small, so sin/cos(E-dE) come from a second order expansion */
+static void kernel_table_scalar(struct kepler_batch* kb, int i0, int i1, double t)
+{
+	for (int i = i0; i < i1; i++) {
+		double r = kb->M0[i] + kb->mean_motion[i] * t;
+		float M = (float)((r - floor(r + 0.5)) * TAU);
+		float e = kb->e[i];
+		float E = table_lookup(fabsf(M), e);
+		if (M < 0) E = -E;
+		float s = sinf(E);
+		float c = cosf(E);
+		float f = E - e*s - M;
+		float f1 = 1 - e*c;
+		float dE = f / (f1 - 0.5f * f * e*s / f1);
+		float h = 1 - 0.5f*dE*dE;
+		float s2 = s*h - c*dE;
+		float c2 = c*h + s*dE;
+		kb->E[i] = E - dE;
+		float Ex = (c2 - e) * kb->a[i];
+		float Ey = s2 * kb->b[i];
+		kb->x[i] = kb->cos_lop[i] * Ex - kb->sin_lop[i] * Ey;
+		kb->y[i] = kb->sin_lop[i] * Ex + kb->cos_lop[i] * Ey;
+	}
+}
+
+#ifdef KEPLER_X86
+
+/* sin/cos polynomials are the cephes sinf/cosf ones. the argument is reduced
+ * by the nearest multiple of pi/2 in three parts (Cody-Waite), which is
+ * accurate for the |x| < 2pi or so that the solver produces */
+#define PIO2_1 (1.5703125f)
+#define PIO2_2 (4.837512969970703125e-4f)
+#define PIO2_3 (7.54978995489188216e-8f)
+#define SIN_P0 (-1.9515295891e-4f)
+#define SIN_P1 (8.3321608736e-3f)
+#define SIN_P2 (-1.6666654611e-1f)
+#define COS_P0 (2.443315711809948e-5f)
+#define COS_P1 (-1.388731625493765e-3f)
+#define COS_P2 (4.166664568298827e-2f)
+
+__attribute__((target("sse4.1")))
+static inline void sincos_ps4(__m128 x, __m128* s, __m128* c)
+{
+	__m128i j = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(4.0/TAU)));
+	__m128 jf = _mm_cvtepi32_ps(j);
+	__m128 y = _mm_sub_ps(x, _mm_mul_ps(jf, _mm_set1_ps(PIO2_1)));
+	y = _mm_sub_ps(y, _mm_mul_ps(jf, _mm_set1_ps(PIO2_2)));
+	y = _mm_sub_ps(y, _mm_mul_ps(jf, _mm_set1_ps(PIO2_3)));
+	__m128 z = _mm_mul_ps(y, y);
+
+	__m128 sp = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+	sp = _mm_add_ps(_mm_mul_ps(sp, z), _mm_set1_ps(SIN_P2));
+	sp = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sp, z), y), y);
+
+	__m128 cp = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+	cp = _mm_add_ps(_mm_mul_ps(cp, z), _mm_set1_ps(COS_P2));
+	cp = _mm_mul_ps(_mm_mul_ps(cp, z), z);
+	cp = _mm_add_ps(_mm_sub_ps(cp, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+	// quadrant fixup: odd quadrants swap sin/cos, then sign flips
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 ss = _mm_blendv_ps(sp, cp, swap);
+	__m128 cc = _mm_blendv_ps(cp, sp, swap);
+	__m128i two = _mm_set1_epi32(2);
+	__m128 s_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, two), 30));
+	__m128 c_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), two), 30));
+	*s = _mm_xor_ps(ss, s_sign);
+	*c = _mm_xor_ps(cc, c_sign);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 mean_anomaly_ps4(struct kepler_batch* kb, int i, __m128d t)
+{
+	__m128d r0 = _mm_add_pd(_mm_loadu_pd(&kb->M0[i]), _mm_mul_pd(_mm_loadu_pd(&kb->mean_motion[i]), t));
+	__m128d r1 = _mm_add_pd(_mm_loadu_pd(&kb->M0[i+2]), _mm_mul_pd(_mm_loadu_pd(&kb->mean_motion[i+2]), t));
+	r0 = _mm_sub_pd(r0, _mm_round_pd(r0, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	r1 = _mm_sub_pd(r1, _mm_round_pd(r1, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	__m128 M = _mm_movelh_ps(_mm_cvtpd_ps(r0), _mm_cvtpd_ps(r1));
+	return _mm_mul_ps(M, _mm_set1_ps(TAU));
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 abs_ps4(__m128 x)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128 kepler_guess_ps4(__m128 M, __m128 e)
+{
+	__m128 s, c;
+	sincos_ps4(M, &s, &c);
+	__m128 small = _mm_add_ps(M, _mm_mul_ps(e, s));
+	__m128 sign1 = _mm_or_ps(_mm_and_ps(s, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.85f));
+	__m128 danby = _mm_add_ps(M, _mm_mul_ps(e, sign1));
+	return _mm_blendv_ps(small, danby, _mm_cmpge_ps(e, _mm_set1_ps(0.8f)));
+}
+
+// one Halley step; returns |dE|
+__attribute__((target("sse4.1")))
+static inline __m128 kepler_halley_ps4(__m128 M, __m128 e, __m128* E)
+{
+	__m128 s, c;
+	sincos_ps4(*E, &s, &c);
+	__m128 es = _mm_mul_ps(e, s);
+	__m128 f = _mm_sub_ps(_mm_sub_ps(*E, es), M);
+	__m128 f1 = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(e, c));
+	__m128 den = _mm_sub_ps(f1, _mm_div_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), f), es), f1));
+	__m128 dE = _mm_div_ps(f, den);
+	*E = _mm_sub_ps(*E, dE);
+	return abs_ps4(dE);
+}
+
+// 8 bodies per step, as two interleaved vectors to hide latency
+__attribute__((target("sse4.1")))
+static void kernel_sse41(struct kepler_batch* kb, int i0, int i1, double t)
+{
+	__m128d tv = _mm_set1_pd(t);
+	__m128 tol = _mm_set1_ps(KEPLER_TOLERANCE);
+	for (int i = i0; i < i1; i += 8) {
+		__m128 M[2], e[2], E[2], s[2], c[2];
+		for (int k = 0; k < 2; k++) {
+			M[k] = mean_anomaly_ps4(kb, i + k*4, tv);
+			e[k] = _mm_loadu_ps(&kb->e[i + k*4]);
+			if (kb->warm_start) {
+				E[k] = _mm_loadu_ps(&kb->E[i + k*4]);
+				sincos_ps4(E[k], &s[k], &c[k]);
+				__m128 f = _mm_sub_ps(_mm_sub_ps(E[k], _mm_mul_ps(e[k], s[k])), M[k]);
+				__m128 f1 = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(e[k], c[k]));
+				__m128 bad = _mm_cmpnlt_ps(abs_ps4(f), _mm_mul_ps(f1, _mm_set1_ps(KEPLER_WARM_THRESHOLD)));
+				if (_mm_movemask_ps(bad)) E[k] = _mm_blendv_ps(E[k], kepler_guess_ps4(M[k], e[k]), bad);
+			} else {
+				E[k] = kepler_guess_ps4(M[k], e[k]);
+			}
+		}
+		for (int it = 0; it < KEPLER_MAX_ITERATIONS; it++) {
+			int busy = 0;
+			for (int k = 0; k < 2; k++) {
+				__m128 dE = kepler_halley_ps4(M[k], e[k], &E[k]);
+				busy |= _mm_movemask_ps(_mm_cmpge_ps(dE, tol));
+			}
+			if (!busy) break;
+		}
+		for (int k = 0; k < 2; k++) {
+			int ik = i + k*4;
+			_mm_storeu_ps(&kb->E[ik], E[k]);
+			sincos_ps4(E[k], &s[k], &c[k]);
+			__m128 Ex = _mm_mul_ps(_mm_sub_ps(c[k], e[k]), _mm_loadu_ps(&kb->a[ik]));
+			__m128 Ey = _mm_mul_ps(s[k], _mm_loadu_ps(&kb->b[ik]));
+			__m128 Bx = _mm_loadu_ps(&kb->cos_lop[ik]);
+			__m128 By = _mm_loadu_ps(&kb->sin_lop[ik]);
+			_mm_storeu_ps(&kb->x[ik], _mm_sub_ps(_mm_mul_ps(Bx, Ex), _mm_mul_ps(By, Ey)));
+			_mm_storeu_ps(&kb->y[ik], _mm_add_ps(_mm_mul_ps(By, Ex), _mm_mul_ps(Bx, Ey)));
+		}
+	}
+}
+
+// SSE has no gather, so corners are fetched one lane at a time
+__attribute__((target("sse4.1")))
+static void kernel_table_sse41(struct kepler_batch* kb, int i0, int i1, double t)
+{
+	__m128d tv = _mm_set1_pd(t);
+	__m128 sign_mask = _mm_set1_ps(-0.0f);
+	for (int i = i0; i < i1; i += 4) {
+		__m128 M = mean_anomaly_ps4(kb, i, tv);
+		__m128 e = _mm_loadu_ps(&kb->e[i]);
+		__m128 Mabs = _mm_andnot_ps(sign_mask, M);
+		__m128 fm = _mm_mul_ps(Mabs, _mm_set1_ps(TABLE_NM / (TAU/2)));
+		__m128 fe = _mm_mul_ps(e, _mm_set1_ps(TABLE_NE / KEPLER_TABLE_E_MAX));
+		__m128i im = _mm_min_epi32(_mm_cvttps_epi32(fm), _mm_set1_epi32(TABLE_NM-1));
+		__m128i ie = _mm_min_epi32(_mm_cvttps_epi32(fe), _mm_set1_epi32(TABLE_NE-1));
+		__m128 tm = _mm_sub_ps(fm, _mm_cvtepi32_ps(im));
+		__m128 te = _mm_sub_ps(fe, _mm_cvtepi32_ps(ie));
+		int idx[4];
+		_mm_storeu_si128((__m128i*)idx, _mm_add_epi32(_mm_mullo_epi32(ie, _mm_set1_epi32(TABLE_STRIDE)), im));
+		float c00[4], c01[4], c10[4], c11[4];
+		for (int k = 0; k < 4; k++) {
+			const float* p = &table[idx[k]];
+			c00[k] = p[0];
+			c01[k] = p[1];
+			c10[k] = p[TABLE_STRIDE];
+			c11[k] = p[TABLE_STRIDE+1];
+		}
+		__m128 p00 = _mm_loadu_ps(c00);
+		__m128 p10 = _mm_loadu_ps(c10);
+		__m128 d0 = _mm_add_ps(p00, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(c01), p00), tm));
+		__m128 d1 = _mm_add_ps(p10, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(c11), p10), tm));
+		__m128 E = _mm_add_ps(Mabs, _mm_add_ps(d0, _mm_mul_ps(_mm_sub_ps(d1, d0), te)));
+		E = _mm_or_ps(E, _mm_and_ps(M, sign_mask));
+
+		__m128 s, c;
+		sincos_ps4(E, &s, &c);
+		__m128 es = _mm_mul_ps(e, s);
+		__m128 f = _mm_sub_ps(_mm_sub_ps(E, es), M);
+		__m128 f1 = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(e, c));
+		__m128 den = _mm_sub_ps(f1, _mm_div_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), f), es), f1));
+		__m128 dE = _mm_div_ps(f, den);
+		__m128 h = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), _mm_mul_ps(dE, dE)));
+		__m128 s2 = _mm_sub_ps(_mm_mul_ps(s, h), _mm_mul_ps(c, dE));
+		__m128 c2 = _mm_add_ps(_mm_mul_ps(c, h), _mm_mul_ps(s, dE));
+		_mm_storeu_ps(&kb->E[i], _mm_sub_ps(E, dE));
+
+		__m128 Ex = _mm_mul_ps(_mm_sub_ps(c2, e), _mm_loadu_ps(&kb->a[i]));
+		__m128 Ey = _mm_mul_ps(s2, _mm_loadu_ps(&kb->b[i]));
+		__m128 Bx = _mm_loadu_ps(&kb->cos_lop[i]);
+		__m128 By = _mm_loadu_ps(&kb->sin_lop[i]);
+		_mm_storeu_ps(&kb->x[i], _mm_sub_ps(_mm_mul_ps(Bx, Ex), _mm_mul_ps(By, Ey)));
+		_mm_storeu_ps(&kb->y[i], _mm_add_ps(_mm_mul_ps(By, Ex), _mm_mul_ps(Bx, Ey)));
+	}
+}
+
+__attribute__((target("avx2")))
+static inline void sincos_ps8(__m256 x, __m256* s, __m256* c)
+{
+	__m256i j = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(4.0/TAU)));
+	__m256 jf = _mm256_cvtepi32_ps(j);
+	__m256 y = _mm256_sub_ps(x, _mm256_mul_ps(jf, _mm256_set1_ps(PIO2_1)));
+	y = _mm256_sub_ps(y, _mm256_mul_ps(jf, _mm256_set1_ps(PIO2_2)));
+	y = _mm256_sub_ps(y, _mm256_mul_ps(jf, _mm256_set1_ps(PIO2_3)));
+	__m256 z = _mm256_mul_ps(y, y);
+
+	__m256 sp = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SIN_P0), z), _mm256_set1_ps(SIN_P1));
+	sp = _mm256_add_ps(_mm256_mul_ps(sp, z), _mm256_set1_ps(SIN_P2));
+	sp = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(sp, z), y), y);
+
+	__m256 cp = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(COS_P0), z), _mm256_set1_ps(COS_P1));
+	cp = _mm256_add_ps(_mm256_mul_ps(cp, z), _mm256_set1_ps(COS_P2));
+	cp = _mm256_mul_ps(_mm256_mul_ps(cp, z), z);
+	cp = _mm256_add_ps(_mm256_sub_ps(cp, _mm256_mul_ps(z, _mm256_set1_ps(0.5f))), _mm256_set1_ps(1.0f));
+
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 ss = _mm256_blendv_ps(sp, cp, swap);
+	__m256 cc = _mm256_blendv_ps(cp, sp, swap);
+	__m256i two = _mm256_set1_epi32(2);
+	__m256 s_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, two), 30));
+	__m256 c_sign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), two), 30));
+	*s = _mm256_xor_ps(ss, s_sign);
+	*c = _mm256_xor_ps(cc, c_sign);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 mean_anomaly_ps8(struct kepler_batch* kb, int i, __m256d t)
+{
+	__m256d r0 = _mm256_add_pd(_mm256_loadu_pd(&kb->M0[i]), _mm256_mul_pd(_mm256_loadu_pd(&kb->mean_motion[i]), t));
+	__m256d r1 = _mm256_add_pd(_mm256_loadu_pd(&kb->M0[i+4]), _mm256_mul_pd(_mm256_loadu_pd(&kb->mean_motion[i+4]), t));
+	r0 = _mm256_sub_pd(r0, _mm256_round_pd(r0, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	r1 = _mm256_sub_pd(r1, _mm256_round_pd(r1, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+	__m256 M = _mm256_set_m128(_mm256_cvtpd_ps(r1), _mm256_cvtpd_ps(r0));
+	return _mm256_mul_ps(M, _mm256_set1_ps(TAU));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 abs_ps8(__m256 x)
+{
+	return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 kepler_guess_ps8(__m256 M, __m256 e)
+{
+	__m256 s, c;
+	sincos_ps8(M, &s, &c);
+	__m256 small = _mm256_add_ps(M, _mm256_mul_ps(e, s));
+	__m256 sign1 = _mm256_or_ps(_mm256_and_ps(s, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(0.85f));
+	__m256 danby = _mm256_add_ps(M, _mm256_mul_ps(e, sign1));
+	return _mm256_blendv_ps(small, danby, _mm256_cmp_ps(e, _mm256_set1_ps(0.8f), _CMP_GE_OQ));
+}
+
+__attribute__((target("avx2")))
+static inline __m256 kepler_halley_ps8(__m256 M, __m256 e, __m256* E)
+{
+	__m256 s, c;
+	sincos_ps8(*E, &s, &c);
+	__m256 es = _mm256_mul_ps(e, s);
+	__m256 f = _mm256_sub_ps(_mm256_sub_ps(*E, es), M);
+	__m256 f1 = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(e, c));
+	__m256 den = _mm256_sub_ps(f1, _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), f), es), f1));
+	__m256 dE = _mm256_div_ps(f, den);
+	*E = _mm256_sub_ps(*E, dE);
+	return abs_ps8(dE);
+}
+
+// 16 bodies per step
+__attribute__((target("avx2")))
+static void kernel_avx2(struct kepler_batch* kb, int i0, int i1, double t)
+{
+	__m256d tv = _mm256_set1_pd(t);
+	__m256 tol = _mm256_set1_ps(KEPLER_TOLERANCE);
+	for (int i = i0; i < i1; i += 16) {
+		__m256 M[2], e[2], E[2], s[2], c[2];
+		for (int k = 0; k < 2; k++) {
+			M[k] = mean_anomaly_ps8(kb, i + k*8, tv);
+			e[k] = _mm256_loadu_ps(&kb->e[i + k*8]);
+			if (kb->warm_start) {
+				E[k] = _mm256_loadu_ps(&kb->E[i + k*8]);
+				sincos_ps8(E[k], &s[k], &c[k]);
+				__m256 f = _mm256_sub_ps(_mm256_sub_ps(E[k], _mm256_mul_ps(e[k], s[k])), M[k]);
+				__m256 f1 = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(e[k], c[k]));
+				__m256 bad = _mm256_cmp_ps(abs_ps8(f), _mm256_mul_ps(f1, _mm256_set1_ps(KEPLER_WARM_THRESHOLD)), _CMP_NLT_UQ);
+				if (_mm256_movemask_ps(bad)) E[k] = _mm256_blendv_ps(E[k], kepler_guess_ps8(M[k], e[k]), bad);
+			} else {
+				E[k] = kepler_guess_ps8(M[k], e[k]);
+			}
+		}
+		for (int it = 0; it < KEPLER_MAX_ITERATIONS; it++) {
+			int busy = 0;
+			for (int k = 0; k < 2; k++) {
+				__m256 dE = kepler_halley_ps8(M[k], e[k], &E[k]);
+				busy |= _mm256_movemask_ps(_mm256_cmp_ps(dE, tol, _CMP_GE_OQ));
+			}
+			if (!busy) break;
+		}
+		for (int k = 0; k < 2; k++) {
+			int ik = i + k*8;
+			_mm256_storeu_ps(&kb->E[ik], E[k]);
+			sincos_ps8(E[k], &s[k], &c[k]);
+			__m256 Ex = _mm256_mul_ps(_mm256_sub_ps(c[k], e[k]), _mm256_loadu_ps(&kb->a[ik]));
+			__m256 Ey = _mm256_mul_ps(s[k], _mm256_loadu_ps(&kb->b[ik]));
+			__m256 Bx = _mm256_loadu_ps(&kb->cos_lop[ik]);
+			__m256 By = _mm256_loadu_ps(&kb->sin_lop[ik]);
+			_mm256_storeu_ps(&kb->x[ik], _mm256_sub_ps(_mm256_mul_ps(Bx, Ex), _mm256_mul_ps(By, Ey)));
+			_mm256_storeu_ps(&kb->y[ik], _mm256_add_ps(_mm256_mul_ps(By, Ex), _mm256_mul_ps(Bx, Ey)));
+		}
+	}
+}
+
+__attribute__((target("avx2")))
+static void kernel_table_avx2(struct kepler_batch* kb, int i0, int i1, double t)
+{
+	__m256d tv = _mm256_set1_pd(t);
+	__m256 sign_mask = _mm256_set1_ps(-0.0f);
+	for (int i = i0; i < i1; i += 8) {
+		__m256 M = mean_anomaly_ps8(kb, i, tv);
+		__m256 e = _mm256_loadu_ps(&kb->e[i]);
+		__m256 Mabs = _mm256_andnot_ps(sign_mask, M);
+		__m256 fm = _mm256_mul_ps(Mabs, _mm256_set1_ps(TABLE_NM / (TAU/2)));
+		__m256 fe = _mm256_mul_ps(e, _mm256_set1_ps(TABLE_NE / KEPLER_TABLE_E_MAX));
+		__m256i im = _mm256_min_epi32(_mm256_cvttps_epi32(fm), _mm256_set1_epi32(TABLE_NM-1));
+		__m256i ie = _mm256_min_epi32(_mm256_cvttps_epi32(fe), _mm256_set1_epi32(TABLE_NE-1));
+		__m256 tm = _mm256_sub_ps(fm, _mm256_cvtepi32_ps(im));
+		__m256 te = _mm256_sub_ps(fe, _mm256_cvtepi32_ps(ie));
+		__m256i idx = _mm256_add_epi32(_mm256_mullo_epi32(ie, _mm256_set1_epi32(TABLE_STRIDE)), im);
+		__m256 p00 = _mm256_i32gather_ps(table, idx, 4);
+		__m256 p01 = _mm256_i32gather_ps(table + 1, idx, 4);
+		__m256 p10 = _mm256_i32gather_ps(table + TABLE_STRIDE, idx, 4);
+		__m256 p11 = _mm256_i32gather_ps(table + TABLE_STRIDE + 1, idx, 4);
+		__m256 d0 = _mm256_add_ps(p00, _mm256_mul_ps(_mm256_sub_ps(p01, p00), tm));
+		__m256 d1 = _mm256_add_ps(p10, _mm256_mul_ps(_mm256_sub_ps(p11, p10), tm));
+		__m256 E = _mm256_add_ps(Mabs, _mm256_add_ps(d0, _mm256_mul_ps(_mm256_sub_ps(d1, d0), te)));
+		E = _mm256_or_ps(E, _mm256_and_ps(M, sign_mask));
+
+		__m256 s, c;
+		sincos_ps8(E, &s, &c);
+		__m256 es = _mm256_mul_ps(e, s);
+		__m256 f = _mm256_sub_ps(_mm256_sub_ps(E, es), M);
+		__m256 f1 = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(e, c));
+		__m256 den = _mm256_sub_ps(f1, _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(0.5f), f), es), f1));
+		__m256 dE = _mm256_div_ps(f, den);
+		__m256 h = _mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), _mm256_mul_ps(dE, dE)));
+		__m256 s2 = _mm256_sub_ps(_mm256_mul_ps(s, h), _mm256_mul_ps(c, dE));
+		__m256 c2 = _mm256_add_ps(_mm256_mul_ps(c, h), _mm256_mul_ps(s, dE));
+		_mm256_storeu_ps(&kb->E[i], _mm256_sub_ps(E, dE));
+
+		__m256 Ex = _mm256_mul_ps(_mm256_sub_ps(c2, e), _mm256_loadu_ps(&kb->a[i]));
+		__m256 Ey = _mm256_mul_ps(s2, _mm256_loadu_ps(&kb->b[i]));
+		__m256 Bx = _mm256_loadu_ps(&kb->cos_lop[i]);
+		__m256 By = _mm256_loadu_ps(&kb->sin_lop[i]);
+		_mm256_storeu_ps(&kb->x[i], _mm256_sub_ps(_mm256_mul_ps(Bx, Ex), _mm256_mul_ps(By, Ey)));
+		_mm256_storeu_ps(&kb->y[i], _mm256_add_ps(_mm256_mul_ps(By, Ex), _mm256_mul_ps(Bx, Ey)));
+	}
+}
+
+#endif/*KEPLER_X86*/
+
+static kepler_kernel kernel;
+static kepler_kernel kernel_table;
+static const char* kernel_name;
+
+int kepler_batch_set_kernel(const char* name)
+{
+	#ifdef KEPLER_X86
+	__builtin_cpu_init();
+	if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+		kernel = kernel_avx2;
+		kernel_table = kernel_table_avx2;
+		kernel_name = "avx2";
+		return 1;
+	}
+	if (strcmp(name, "sse41") == 0 && __builtin_cpu_supports("sse4.1")) {
+		kernel = kernel_sse41;
+		kernel_table = kernel_table_sse41;
+		kernel_name = "sse41";
+		return 1;
+	}
+	#endif
+	if (strcmp(name, "scalar") == 0) {
+		kernel = kernel_scalar;
+		kernel_table = kernel_table_scalar;
+		kernel_name = "scalar";
+		return 1;
+	}
+	return 0;
+}
+
+static void pick_kernel()
+{
+	if (kernel != NULL) return;
+
+	// KEPLER_KERNEL=scalar|sse41|avx2 forces a kernel (if supported)
+	const char* force = getenv("KEPLER_KERNEL");
+	if (force != NULL && kepler_batch_set_kernel(force)) return;
+
+	if (kepler_batch_set_kernel("avx2")) return;
+	if (kepler_batch_set_kernel("sse41")) return;
+	AN(kepler_batch_set_kernel("scalar"));
+}
+
+const char* kepler_batch_kernel_name()
+{
+	pick_kernel();
+	return kernel_name;
+}
+
+void kepler_batch_init(struct kepler_batch* kb, struct celestial_body* bodies, int n)
+{
+	memset(kb, 0, sizeof(*kb));
+	AN(n);
+	kb->n = n;
+	kb->n_padded = (n + KEPLER_BATCH_PAD - 1) / KEPLER_BATCH_PAD * KEPLER_BATCH_PAD;
+	kb->bodies = bodies;
+	int np = kb->n_padded;
+
+	AN(kb->parent = calloc(np, sizeof(int)));
+	AN(kb->M0 = calloc(np, sizeof(double)));
+	AN(kb->mean_motion = calloc(np, sizeof(double)));
+	AN(kb->a = calloc(np, sizeof(float)));
+	AN(kb->b = calloc(np, sizeof(float)));
+	AN(kb->e = calloc(np, sizeof(float)));
+	AN(kb->cos_lop = calloc(np, sizeof(float)));
+	AN(kb->sin_lop = calloc(np, sizeof(float)));
+	AN(kb->x = calloc(np, sizeof(float)));
+	AN(kb->y = calloc(np, sizeof(float)));
+	AN(kb->E = calloc(np, sizeof(float)));
+	kb->warm_start = 1;
+	AN(kb->runs = calloc(np / KEPLER_BATCH_PAD, sizeof(struct kepler_run)));
+	kepler_table_init();
+
+	int* level = calloc(n, sizeof(int));
+	AN(level);
+
+	for (int i = 0; i < n; i++) {
+		struct celestial_body* body = &bodies[i];
+		if (body->parent < 0) {
+			AZ(i);
+			kb->parent[i] = -1;
+			continue;
+		}
+
+		int p = body->parent;
+		ASSERT(p >= 0 && p < i); // breadth-first order
+		kb->parent[i] = p;
+		level[i] = level[p] + 1;
+		ASSERT(level[i] >= level[i-1]);
+	}
+
+	kb->n_levels = level[n-1] + 1;
+	AN(kb->level_start = calloc(kb->n_levels + 1, sizeof(int)));
+	for (int i = 0; i < n; i++) kb->level_start[level[i] + 1] = i + 1;
+	free(level);
+
+	kepler_batch_load(kb);
+}
+
+void kepler_batch_free(struct kepler_batch* kb)
+{
+	free(kb->level_start);
+	free(kb->parent);
+	free(kb->M0);
+	free(kb->mean_motion);
+	free(kb->a);
+	free(kb->b);
+	free(kb->e);
+	free(kb->cos_lop);
+	free(kb->sin_lop);
+	free(kb->x);
+	free(kb->y);
+	free(kb->E);
+	free(kb->runs);
+	memset(kb, 0, sizeof(*kb));
+}
+
+void kepler_batch_load(struct kepler_batch* kb)
+{
+	for (int i = 1; i < kb->n; i++) {
+		struct celestial_body* body = &kb->bodies[i];
+		kb->mean_motion[i] = body->mean_motion_rad_s / TAU;
+		kb->M0[i] = body->M0_rad / TAU;
+		kb->a[i] = body->semi_major_axis_km;
+		kb->b[i] = body->semi_minor_axis_km;
+		kb->e[i] = body->eccentricity;
+		kb->cos_lop[i] = body->cos_lop;
+		kb->sin_lop[i] = body->sin_lop;
+	}
+
+	/* split into runs of KEPLER_BATCH_PAD-sized blocks that can all use the
+	 * table solver, and blocks that can't */
+	kb->n_runs = 0;
+	for (int i0 = 0; i0 < kb->n_padded; i0 += KEPLER_BATCH_PAD) {
+		int use_table = 1;
+		for (int i = i0; i < i0 + KEPLER_BATCH_PAD && i < kb->n; i++) {
+			struct celestial_body* body = &kb->bodies[i];
+			if (body->kepler_solver != KEPLER_TABLE || !(body->eccentricity <= KEPLER_TABLE_E_MAX)) {
+				use_table = 0;
+				break;
+			}
+		}
+		struct kepler_run* last = kb->n_runs > 0 ? &kb->runs[kb->n_runs - 1] : NULL;
+		if (last != NULL && last->table == use_table) {
+			last->i1 += KEPLER_BATCH_PAD;
+		} else {
+			struct kepler_run* run = &kb->runs[kb->n_runs++];
+			run->i0 = i0;
+			run->i1 = i0 + KEPLER_BATCH_PAD;
+			run->table = use_table;
+		}
+	}
+
+	kb->generation = sol_elements_generation;
+}
+
+/* propagation runs on the pool in two steps: relative positions for any
+ * chunk of blocks (no dependencies), then relative -> absolute one level at
+ * a time so parents are always done */
+
+#define KEPLER_TASK_BLOCKS (64)
+#define KEPLER_TASK_BODIES (4096)
+
+struct propagate_job {
+	struct kepler_batch* kb;
+	double t;
+	int level;
+};
+
+static void relative_task(void* usr, int b0, int b1)
+{
+	struct propagate_job* job = usr;
+	struct kepler_batch* kb = job->kb;
+	int i0 = b0 * KEPLER_BATCH_PAD;
+	int i1 = b1 * KEPLER_BATCH_PAD;
+	TRACE_BEGIN("kepler relative");
+
+	// first run ending after i0
+	int lo = 0;
+	int hi = kb->n_runs - 1;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (kb->runs[mid].i1 <= i0) lo = mid + 1; else hi = mid;
+	}
+
+	for (int r = lo; r < kb->n_runs && kb->runs[r].i0 < i1; r++) {
+		struct kepler_run* run = &kb->runs[r];
+		int j0 = run->i0 > i0 ? run->i0 : i0;
+		int j1 = run->i1 < i1 ? run->i1 : i1;
+		(run->table ? kernel_table : kernel)(kb, j0, j1, job->t);
+	}
+	TRACE_END("kepler relative");
+}
+
+static void absolute_task(void* usr, int j0, int j1)
+{
+	struct propagate_job* job = usr;
+	struct kepler_batch* kb = job->kb;
+	int start = kb->level_start[job->level];
+	TRACE_BEGIN("kepler absolute");
+	for (int i = start + j0; i < start + j1; i++) {
+		int p = kb->parent[i];
+		kb->x[i] += kb->x[p];
+		kb->y[i] += kb->y[p];
+	}
+	TRACE_END("kepler absolute");
+}
+
+void kepler_batch_propagate(struct kepler_batch* kb, double t)
+{
+	pick_kernel();
+	if (kb->generation != sol_elements_generation) kepler_batch_load(kb);
+
+	struct propagate_job job = {kb, t, 0};
+	pool_for(kb->n_padded / KEPLER_BATCH_PAD, KEPLER_TASK_BLOCKS, relative_task, &job);
+
+	kb->x[0] = 0;
+	kb->y[0] = 0;
+	for (int l = 1; l < kb->n_levels; l++) {
+		job.level = l;
+		pool_for(kb->level_start[l+1] - kb->level_start[l], KEPLER_TASK_BODIES, absolute_task, &job);
+	}
+}
@@ -0,0 +1,92 @@
+#ifndef KEPLER_H
+#define KEPLER_H
+
+#include "sol.h"
+
+float eccentric_anomaly_from_mean_anomaly(float M, float eccentricity, int iterations);
+float mean_anomaly_from_eccentric_anomaly(float E, float eccentricity);
+
+// eccentric anomaly for any M; the result is in [-pi;pi]
+float kepler_solve(float M, float e);
+// same, but starting from E (e.g. last frame's solution) when it is close
+float kepler_solve_warm(float M, float e, float E);
+
+// double precision, to convergence; for offline work, not per frame
+double kepler_solve_double(double M, double e);
+
+// table lookup plus one correction; falls back to kepler_solve() above
+// KEPLER_TABLE_E_MAX. the table is built by kepler_table_init() (~1ms)
+#define KEPLER_TABLE_E_MAX (0.9f)
+void kepler_table_init();
+float kepler_solve_table(float M, float e);
+
+void calc_ellipse_position(
+	float eccentric_anomaly,
+	float eccentricity,
+	float semi_major_axis,
+	float semi_minor_axis,
+	float cos_lop,
+	float sin_lop,
+	float* x,
+	float* y,
+	float* nx,
+	float* ny);
+
+void kepler_calc_relative_position(struct celestial_body* body, struct celestial_body* parent, float t, float* dx, float* dy);
+
+/* orbital elements of a breadth-first body array (as returned by mksol()) in
+ * structure-of-arrays form. arrays are padded to a multiple of
+ * KEPLER_BATCH_PAD with zero elements so the SIMD kernels have no tail */
+
+#define KEPLER_BATCH_PAD (16)
+
+struct kepler_batch {
+	int n;
+	int n_padded;
+
+	int n_levels;
+	int* level_start; // n_levels+1 entries; bodies of level l are [level_start[l];level_start[l+1])
+	int* parent; // -1 for the root
+
+	// mean anomaly in revolutions is M0 + mean_motion*t; kept in double
+	// because t is in seconds and grows large
+	double* M0;
+	double* mean_motion;
+
+	float* a;
+	float* b;
+	float* e;
+	float* cos_lop;
+	float* sin_lop;
+
+	// output; absolute positions after kepler_batch_propagate()
+	float* x;
+	float* y;
+
+	// eccentric anomalies of the last propagation; reused as starting
+	// guesses when warm_start is set (the default)
+	float* E;
+	int warm_start;
+
+	// ranges handled by the table or the iterative kernel; a block only goes
+	// to the table kernel if all of its bodies have kepler_solver ==
+	// KEPLER_TABLE and e <= KEPLER_TABLE_E_MAX
+	int n_runs;
+	struct kepler_run {
+		int i0, i1;
+		int table;
+	}* runs;
+
+	struct celestial_body* bodies;
+	int generation; // sol_elements_generation at last load
+};
+
+void kepler_batch_init(struct kepler_batch* kb, struct celestial_body* bodies, int n);
+void kepler_batch_free(struct kepler_batch* kb);
+void kepler_batch_load(struct kepler_batch* kb);
+void kepler_batch_propagate(struct kepler_batch* kb, double t);
+const char* kepler_batch_kernel_name();
+// "scalar", "sse41" or "avx2"; returns 0 if not supported on this CPU
+int kepler_batch_set_kernel(const char* name);
+
+#endif/*KEPLER_H*/
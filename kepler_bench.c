@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "a.h"
+#include "m.h"
+#include "sol.h"
+#include "kepler.h"
+
+/* kepler_bench: accuracy and throughput of the Kepler solvers over a grid of
+ * (M, e). errors are |E - E_ref| in radians, where E_ref is solved in long
+ * double by safeguarded Newton. the batch_* rows go through
+ * kepler_batch_propagate(), so their error also includes rounding of M from
+ * the elements, and their time includes the position calculation */
+
+#define N_M (4096)
+#define REPEAT (200)
+
+static const float eccentricities[] = {
+	0, 0.0001, 0.01, 0.05, 0.1, 0.2, 0.3, 0.5, 0.7, 0.8, 0.9, 0.95, 0.99
+};
+#define N_E (sizeof(eccentricities) / sizeof(eccentricities[0]))
+
+static float grid_M[N_M];
+static long double grid_E[N_M];
+
+static long double ref_solve(long double M, long double e)
+{
+	// for M in [-pi;pi], E lies between M and M+e*sign(M)
+	long double lo = M < 0 ? M - e : M;
+	long double hi = M < 0 ? M : M + e;
+	long double E = (lo + hi) / 2;
+	for (int i = 0; i < 200; i++) {
+		long double f = E - e*sinl(E) - M;
+		if (f > 0) hi = E; else lo = E;
+		long double En = E - f / (1 - e*cosl(E));
+		if (En <= lo || En >= hi) En = (lo + hi) / 2;
+		if (fabsl(En - E) < 1e-18L) return En;
+		E = En;
+	}
+	return E;
+}
+
+static double angle_error(float E, long double ref)
+{
+	long double d = (long double)E - ref;
+	d -= TAU * floorl(d / TAU + 0.5L);
+	return fabsl(d);
+}
+
+static void report(const char* solver, float e, double max_err, double ns)
+{
+	printf("%-20s %-8g %-12.3e %8.2f\n", solver, e, max_err, ns);
+}
+
+enum solver {
+	FIXED10,
+	HALLEY,
+	HALLEY_WARM,
+	TABLE
+};
+
+static void bench_scalar(enum solver solver, const char* name, float e)
+{
+	float E[N_M];
+	double max_err = 0;
+	for (int i = 0; i < N_M; i++) {
+		float M = grid_M[i];
+		switch (solver) {
+			case FIXED10: E[i] = eccentric_anomaly_from_mean_anomaly(M, e, 10); break;
+			case HALLEY: E[i] = kepler_solve(M, e); break;
+			// previous grid point stands in for the previous frame
+			case HALLEY_WARM: E[i] = kepler_solve_warm(M, e, i > 0 ? E[i-1] : 0); break;
+			case TABLE: E[i] = kepler_solve_table(M, e); break;
+		}
+		double err = angle_error(E[i], grid_E[i]);
+		if (err > max_err) max_err = err;
+	}
+
+	volatile float sink = 0;
+	double t0 = now();
+	for (int r = 0; r < REPEAT; r++) {
+		float acc = 0;
+		float prev = 0;
+		for (int i = 0; i < N_M; i++) {
+			float M = grid_M[i];
+			switch (solver) {
+				case FIXED10: prev = eccentric_anomaly_from_mean_anomaly(M, e, 10); break;
+				case HALLEY: prev = kepler_solve(M, e); break;
+				case HALLEY_WARM: prev = kepler_solve_warm(M, e, prev); break;
+				case TABLE: prev = kepler_solve_table(M, e); break;
+			}
+			acc += prev;
+		}
+		sink += acc;
+	}
+	double t1 = now();
+	(void)sink;
+
+	report(name, e, max_err, (t1 - t0) * 1e9 / ((double)REPEAT * N_M));
+}
+
+static void bench_batch(const char* kernel, int solver, int warm, float e)
+{
+	if (!kepler_batch_set_kernel(kernel)) return;
+
+	// one satellite per grid point, with M0 set so that M(t=0) is the grid M
+	int n = N_M + 1;
+	struct celestial_body* bodies = calloc(n, sizeof(struct celestial_body));
+	AN(bodies);
+	bodies[0].mass_kg = 1e20;
+	bodies[0].parent = -1;
+	bodies[0].n_satellites = n - 1;
+	bodies[0].first_satellite = 1;
+	for (int i = 1; i < n; i++) {
+		bodies[i].parent = 0;
+		bodies[i].kepler_solver = solver;
+		celestial_body_set_elements(bodies, i, 1e4, e, 0, grid_M[i-1]);
+	}
+
+	struct kepler_batch kb;
+	kepler_batch_init(&kb, bodies, n);
+	kb.warm_start = warm;
+
+	kepler_batch_propagate(&kb, 0);
+	double max_err = 0;
+	for (int i = 1; i < n; i++) {
+		double err = angle_error(kb.E[i], grid_E[i-1]);
+		if (err > max_err) max_err = err;
+	}
+
+	double t0 = now();
+	for (int r = 0; r < REPEAT; r++) kepler_batch_propagate(&kb, 0);
+	double t1 = now();
+
+	char name[64];
+	snprintf(name, sizeof(name), "batch_%s%s", kernel, solver == KEPLER_TABLE ? "_table" : warm ? "_warm" : "");
+	report(name, e, max_err, (t1 - t0) * 1e9 / ((double)REPEAT * n));
+
+	kepler_batch_free(&kb);
+	free(bodies);
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 0; i < N_M; i++) {
+		grid_M[i] = ((float)i / (float)N_M - 0.5f) * TAU;
+	}
+
+	printf("%-20s %-8s %-12s %8s\n", "solver", "e", "max_err", "ns/solve");
+	for (int ie = 0; ie < N_E; ie++) {
+		float e = eccentricities[ie];
+		for (int i = 0; i < N_M; i++) grid_E[i] = ref_solve(grid_M[i], e);
+
+		bench_scalar(FIXED10, "fixed10", e);
+		bench_scalar(HALLEY, "halley", e);
+		bench_scalar(HALLEY_WARM, "halley_warm", e);
+		bench_scalar(TABLE, "table", e);
+		const char* kernels[] = {"scalar", "sse41", "avx2"};
+		for (int k = 0; k < 3; k++) {
+			bench_batch(kernels[k], KEPLER_ITERATIVE, 0, e);
+			bench_batch(kernels[k], KEPLER_ITERATIVE, 1, e);
+			bench_batch(kernels[k], KEPLER_TABLE, 0, e);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
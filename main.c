@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <math.h>
 
@@ -10,7 +12,18 @@
 #include "shader.h"
 #include "mud.h"
 #include "sol.h"
+#include "kepler.h"
+#include "ephem.h"
+#include "world.h"
+#include "pool.h"
+#include "simclock.h"
+#include "mpc.h"
+#include "catalog.h"
 #include "text.h"
+#include "orbit.h"
+#include "prof.h"
+#include "trace.h"
+#include "glcheck.h"
 
 static inline float lerpf(float t, float x0, float x1)
 {
@@ -22,80 +35,10 @@ static inline float clampf(float v, float min, float max)
 	return v < min ? min : v > max ? max : v;
 }
 
-static float eccentric_anomaly_from_mean_anomaly(float M, float eccentricity, int iterations)
-{
-	float E = M;
-	for (int i = 0; i < iterations; i++) {
-		E = M + eccentricity * sinf(E);
-	}
-	return E;
-}
-
-static float mean_anomaly_from_eccentric_anomaly(float E, float eccentricity)
-{
-	return E - eccentricity * sinf(E);
-}
-
-static void calc_ellipse_position(
-	float eccentric_anomaly,
-	float eccentricity,
-	float semi_major_axis,
-	float semi_minor_axis,
-	float longitude_of_periapsis,
-	float* x,
-	float* y,
-	float* nx,
-	float* ny)
-{
-	float Bx = cosf(longitude_of_periapsis);
-	float By = sinf(longitude_of_periapsis);
-
-	float Ex = (cosf(eccentric_anomaly) - eccentricity) * semi_major_axis;
-	float Ey = sinf(eccentric_anomaly) * semi_minor_axis;
-	if (x != NULL) *x = Bx * Ex - By * Ey;
-	if (y != NULL) *y = By * Ex + Bx * Ey;
-
-	float Nx = cosf(eccentric_anomaly) * semi_minor_axis;
-	float Ny = sinf(eccentric_anomaly) * semi_major_axis;
-	if (nx != NULL) *nx = Bx * Nx - By * Ny;
-	if (ny != NULL) *ny = By * Nx + Bx * Ny;
-}
-
-static void kepler_calc_relative_position(struct celestial_body* body, struct celestial_body* parent, float t, float* dx, float* dy)
-{
-	float mu = G * parent->mass_kg;
-	float a = body->semi_major_axis_km;
-	float e = body->eccentricity;
-	float b =  a * sqrtf(1 - e*e);
-	float orbital_period = TAU * sqrtf(a*a*a / mu);
-	float M0 = body->mean_longitude_j2000_rad - body->longitude_of_periapsis_rad;
-	float M = M0 + (t / orbital_period) * TAU;
-	float E = eccentric_anomaly_from_mean_anomaly(M, e, 10);
-	calc_ellipse_position(E, e, a, b, body->longitude_of_periapsis_rad, dx, dy, NULL, NULL);
-}
-
-
-struct world {
-	struct celestial_body* sol;
-	int64_t t60;
-};
-
-
-static double world_t1(struct world* world)
-{
-	return (double)world->t60 / 60.0;
-}
-
-void world_init(struct world* world, struct celestial_body* sol)
-{
-	memset(world, 0, sizeof(*world));
-	world->sol = sol;
-}
-
 struct observer {
 	float height_km_target;
 	float height_km;
-	struct celestial_body* cbody;
+	int cbody;
 	float cx, cy;
 };
 
@@ -118,104 +61,148 @@ struct entity {
 };
 #endif
 
+#define ORBIT_TEXTURE_WIDTH (256) // as in path.glsl
+
+// x, y, radius (pixels), light x, y, r, g, b
+#define BODY_INSTANCE_FLOATS (8)
+
+/* antialiasing of the body, sun and path shaders: AA_FAST shades once per
+ * fragment and ramps the edges, the others supersample. each tier is a
+ * permutation of the shaders, with its AA value folded in */
+enum aa_tier {
+	AA_FAST,
+	AA_MEDIUM,
+	AA_HIGH,
+	AA_N
+};
+
+static const char* aa_tier_names[AA_N] = {"fast", "medium", "high"};
+static const int aa_tier_values[AA_N] = {0, 1, 3}; // AA define (3x3, 7x7)
+
+/* attributes are bound to these locations, and uniform locations are
+ * cached per permutation in this order */
+enum {
+	PATH_A_POSITION,
+	PATH_A_NORMAL,
+	PATH_A_UV,
+	PATH_A_COLOR,
+	PATH_A_SLOT,
+	PATH_A_N
+};
+static const char* const path_attributes[PATH_A_N] = {"a_position", "a_normal", "a_uv", "a_color", "a_slot"};
+enum {
+	PATH_U_ORBITS,
+	PATH_U_NDC,
+	PATH_U_WIDTH,
+	PATH_U_MU,
+	PATH_U_N
+};
+static const char* const path_uniforms[PATH_U_N] = {"u_orbits", "u_ndc", "u_width", "u_mu"};
+
+// bodies and suns are both instanced quads; suns only use the first two
+enum {
+	QUAD_A_POSITION,
+	QUAD_A_BODY,
+	QUAD_A_LIGHT,
+	QUAD_A_COLOR,
+	QUAD_A_N
+};
+static const char* const quad_attributes[QUAD_A_N] = {"a_position", "a_body", "a_light", "a_color"};
+enum {
+	QUAD_U_NDC,
+	QUAD_U_N
+};
+static const char* const quad_uniforms[QUAD_U_N] = {"u_ndc"};
+
 struct render {
 	SDL_Window* window;
 	int window_width;
 	int window_height;
 
 	float scale;
+	enum aa_tier aa;
+
+	struct shader_permutations path_shader;
+	struct shader_permutations sun_shader;
+	struct shader_permutations body_shader;
 
-	struct shader path_shader;
-	GLuint path_a_position;
-	GLuint path_a_uv;
-	GLuint path_u_mu;
-	GLuint path_u_color1;
-
-	struct shader sun_shader;
-	GLuint sun_a_position;
-	GLuint sun_u_offset;
-	GLuint sun_u_scale;
-	GLuint sun_u_mu;
-
-	struct shader body_shader;
-	GLuint body_a_position;
-	GLuint body_u_offset;
-	GLuint body_u_scale;
-	GLuint body_u_mu;
-	GLuint body_u_light;
-	GLuint body_u_color;
+	// per-instance BODY_INSTANCE_FLOATS for on-screen bodies, then suns;
+	// streamed per frame
+	GLuint body_instance_buffer;
+	float* body_instance_data;
+	int body_instance_max;
+
+	struct shader point_shader;
+	GLuint point_a_position;
+	GLuint point_u_color;
+	GLuint point_vertex_buffer;
+	float* point_vertex_data;
+	int point_vertex_max;
 
 	GLuint quad_vertex_buffer;
 	GLuint quad_index_buffer;
 
-	GLuint prim_vertex_buffer;
-	float* prim_vertex_data;
-	int prim_vertex_n;
-	int prim_vertex_max;
-	GLuint prim_index_buffer;
-	uint32_t* prim_index_data;
-	int prim_index_n;
-	int prim_index_max;
+	// orbits of all CBR_BODY bodies, in orbit-local coordinates; rebuilt
+	// when the elements change
+	GLuint orbit_vertex_buffer;
+	GLuint orbit_index_buffer;
+	int* orbit_slot; // per body; -1 if it has no orbit
+	int* orbit_body; // per slot
+	int orbit_slot_max;
+	int orbit_generation;
+	int n_orbits;
+	/* per-frame placement of each slot, looked up by the path shader:
+	 * parent offset in pixels and pixels per unit. slot n_orbits is the
+	 * identity, for clipped arcs */
+	GLuint orbit_texture;
+	float* orbit_texels;
+	int orbit_texture_rows;
+	// static levels of detail, drawn with one glMultiDrawElements
+	GLsizei* orbit_draw_counts;
+	const GLvoid** orbit_draw_offsets;
+	// on-screen arcs of orbits that don't fit, streamed per frame
+	GLuint orbit_arc_vertex_buffer;
+	GLuint orbit_arc_index_buffer;
+	float* orbit_arc_vertices;
+	struct orbit_arcs orbit_arcs;
 
 	struct text text;
 };
 
 
-void render_prim_reset(struct render* render)
-{
-	render->prim_vertex_n = 0;
-	render->prim_index_n = 0;
-}
-
-void render_prim_vertex_data(struct render* render, float* xs, int n)
-{
-	ASSERT((render->prim_vertex_n + n) <= render->prim_vertex_max);
-	memcpy(render->prim_vertex_data + render->prim_vertex_n, xs, sizeof(float) * n);
-	render->prim_vertex_n += n;
-}
-
-void render_prim_index_data(struct render* render, uint32_t* xs, int n)
-{
-	ASSERT((render->prim_index_n + n) <= render->prim_index_max);
-	memcpy(render->prim_index_data + render->prim_index_n, xs, sizeof(uint32_t) * n);
-	render->prim_index_n += n;
-}
-
-void render_init(struct render* render, SDL_Window* window)
+/* every program is started before any is waited for, so with
+ * KHR_parallel_shader_compile they compile concurrently; the permutations
+ * for the startup tier are prepared, others compile when F5 selects them */
+void render_init(struct render* render, SDL_Window* window, enum aa_tier aa)
 {
 	memset(render, 0, sizeof(*render));
 	render->window = window;
+	render->aa = aa;
 
 	{ /* path shader */
 		#include "path.glsl.inc"
-		shader_init(&render->path_shader, path_vert_src, path_frag_src);
-		shader_use(&render->path_shader);
-		render->path_a_position = glGetAttribLocation(render->path_shader.program, "a_position"); CHKGL;
-		render->path_a_uv = glGetAttribLocation(render->path_shader.program, "a_uv"); CHKGL;
-		render->path_u_mu = glGetUniformLocation(render->path_shader.program, "u_mu"); CHKGL;
-		render->path_u_color1 = glGetUniformLocation(render->path_shader.program, "u_color1"); CHKGL;
+		shader_permutations_init(&render->path_shader, &path_source, path_attributes, PATH_A_N, path_uniforms, PATH_U_N);
+		shader_permutations_prepare(&render->path_shader, shader_key(&path_source, &aa_tier_values[aa]));
 	}
 
 	{ /* sun shader */
 		#include "sun.glsl.inc"
-		shader_init(&render->sun_shader, sun_vert_src, sun_frag_src);
-		shader_use(&render->sun_shader);
-		render->sun_a_position = glGetAttribLocation(render->sun_shader.program, "a_position"); CHKGL;
-		render->sun_u_offset = glGetUniformLocation(render->sun_shader.program, "u_offset"); CHKGL;
-		render->sun_u_scale = glGetUniformLocation(render->sun_shader.program, "u_scale"); CHKGL;
-		render->sun_u_mu = glGetUniformLocation(render->sun_shader.program, "u_mu"); CHKGL;
+		shader_permutations_init(&render->sun_shader, &sun_source, quad_attributes, QUAD_A_BODY + 1, quad_uniforms, QUAD_U_N);
+		shader_permutations_prepare(&render->sun_shader, shader_key(&sun_source, &aa_tier_values[aa]));
 	}
 
 	{ /* body shader */
 		#include "body.glsl.inc"
-		shader_init(&render->body_shader, body_vert_src, body_frag_src);
-		shader_use(&render->body_shader);
-		render->body_a_position = glGetAttribLocation(render->body_shader.program, "a_position"); CHKGL;
-		render->body_u_offset = glGetUniformLocation(render->body_shader.program, "u_offset"); CHKGL;
-		render->body_u_scale = glGetUniformLocation(render->body_shader.program, "u_scale"); CHKGL;
-		render->body_u_mu = glGetUniformLocation(render->body_shader.program, "u_mu"); CHKGL;
-		render->body_u_light = glGetUniformLocation(render->body_shader.program, "u_light"); CHKGL;
-		render->body_u_color = glGetUniformLocation(render->body_shader.program, "u_color"); CHKGL;
+		shader_permutations_init(&render->body_shader, &body_source, quad_attributes, QUAD_A_N, quad_uniforms, QUAD_U_N);
+		shader_permutations_prepare(&render->body_shader, shader_key(&body_source, &aa_tier_values[aa]));
+	}
+
+	glGenBuffers(1, &render->body_instance_buffer); CHKGL;
+
+	{ /* point shader */
+		#include "point.glsl.inc"
+		shader_init(&render->point_shader, point_vert_src, point_frag_src);
+		glGenBuffers(1, &render->point_vertex_buffer); CHKGL;
 	}
 
 	{ /* quad vertex buffer */
@@ -232,243 +219,366 @@ void render_init(struct render* render, SDL_Window* window)
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW); CHKGL;
 	}
 
-	{ /* primitive vertex buffer */
-		glGenBuffers(1, &render->prim_vertex_buffer); CHKGL;
-		glBindBuffer(GL_ARRAY_BUFFER, render->prim_vertex_buffer); CHKGL;
-		render->prim_vertex_max = 65536;
-		size_t sz = sizeof(float) * render->prim_vertex_max;
-		AN(render->prim_vertex_data = malloc(sz));
-		glBufferData(GL_ARRAY_BUFFER, sz, render->prim_vertex_data, GL_STREAM_DRAW); CHKGL;
-	}
-
-	{ /* primitive index buffer */
-		glGenBuffers(1, &render->prim_index_buffer); CHKGL;
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->prim_index_buffer); CHKGL;
-		render->prim_index_max = 65536;
-		size_t sz = sizeof(int32_t) * render->prim_index_max;
-		AN(render->prim_index_data = malloc(sz));
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sz, render->prim_index_data, GL_STREAM_DRAW); CHKGL;
+	glGenBuffers(1, &render->orbit_vertex_buffer); CHKGL;
+	glGenBuffers(1, &render->orbit_index_buffer); CHKGL;
+	glGenTextures(1, &render->orbit_texture); CHKGL;
+	render->orbit_generation = -1;
+
+	{ /* orbit arc buffers */
+		AN(render->orbit_arc_vertices = malloc(ORBIT_ARC_MAX_VERTICES * ORBIT_FLOATS_PER_VERTEX * sizeof(float)));
+		glGenBuffers(1, &render->orbit_arc_vertex_buffer); CHKGL;
+		glBindBuffer(GL_ARRAY_BUFFER, render->orbit_arc_vertex_buffer); CHKGL;
+		glBufferData(GL_ARRAY_BUFFER, ORBIT_ARC_MAX_VERTICES * ORBIT_FLOATS_PER_VERTEX * sizeof(float), NULL, GL_STREAM_DRAW); CHKGL;
+
+		// quads between consecutive pairs; runs draw subranges
+		int n = ORBIT_ARC_MAX_VERTICES / 2 - 1;
+		uint32_t* indices;
+		AN(indices = malloc(n * 4 * sizeof(uint32_t)));
+		for (int i = 0; i < n; i++) {
+			uint32_t* q = &indices[i*4];
+			q[0] = i*2;
+			q[1] = i*2+1;
+			q[2] = i*2+3;
+			q[3] = i*2+2;
+		}
+		glGenBuffers(1, &render->orbit_arc_index_buffer); CHKGL;
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->orbit_arc_index_buffer); CHKGL;
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * 4 * sizeof(uint32_t), indices, GL_STATIC_DRAW); CHKGL;
+		free(indices);
 	}
 
 	text_init(&render->text);
-}
-
-void render_sun(struct render* render, struct celestial_body* sun)
-{
-	shader_use(&render->sun_shader);
-	{
-		float x = sun->render_x;
-		float y = sun->render_y;
-
-		float dx = x / render->window_width * 2;
-		float dy = y / render->window_height * 2;
-		glUniform2f(render->sun_u_offset, dx, dy); CHKGL;
-
-		float radius = sun->render_radius;
-		float sx = radius / render->window_width * 2;
-		float sy = radius / render->window_height * 2;
-		glUniform2f(render->sun_u_scale, sx, sy); CHKGL;
 
-		float mu = 4.0/(radius*6.0);
-		glUniform1f(render->sun_u_mu, mu); CHKGL;
+	{ /* point shader locations; waits for its link */
+		shader_use(&render->point_shader);
+		render->point_a_position = glGetAttribLocation(render->point_shader.program, "a_position"); CHKGL;
+		render->point_u_color = glGetUniformLocation(render->point_shader.program, "u_color"); CHKGL;
 	}
-
-	glEnableVertexAttribArray(render->sun_a_position); CHKGL;
-	glBindBuffer(GL_ARRAY_BUFFER, render->quad_vertex_buffer); CHKGL;
-	glVertexAttribPointer(render->sun_a_position, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, 0); CHKGL;
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->quad_index_buffer); CHKGL;
-	glDrawElements(GL_QUADS, 4, GL_UNSIGNED_BYTE, NULL); CHKGL;
-	glDisableVertexAttribArray(render->sun_a_position); CHKGL;
 }
 
-void render_body(struct render* render, struct celestial_body* body)
+static void orbit_color(struct celestial_body* body, float* color)
 {
-	shader_use(&render->body_shader);
-	{
-		float x = body->render_x;
-		float y = body->render_y;
-
-		float dx = x / render->window_width * 2;
-		float dy = y / render->window_height * 2;
-		glUniform2f(render->body_u_offset, dx, dy); CHKGL;
+	float grayd = 0.6;
+	for (int i = 0; i < 3; i++) color[i] = lerpf(grayd, body->color[i], 0.4);
+	color[3] = 0.5f;
+}
 
-		float radius = body->render_radius;
-		float sx = radius / render->window_width * 2;
-		float sy = radius / render->window_height * 2;
-		glUniform2f(render->body_u_scale, sx, sy); CHKGL;
+void render_orbits_sync(struct render* render, struct world* world)
+{
+	if (render->orbit_generation == sol_elements_generation && render->orbit_slot_max >= world->n_bodies) return;
+	render->orbit_generation = sol_elements_generation;
 
-		float mu = 4.0/(radius*6.0);
-		glUniform1f(render->body_u_mu, mu); CHKGL;
+	if (render->orbit_slot_max < world->n_bodies) {
+		render->orbit_slot_max = world->n_bodies;
+		AN(render->orbit_slot = realloc(render->orbit_slot, render->orbit_slot_max * sizeof(int)));
+		AN(render->orbit_body = realloc(render->orbit_body, render->orbit_slot_max * sizeof(int)));
+	}
+	int n_orbits = 0;
+	for (int i = 0; i < world->n_bodies; i++) {
+		struct celestial_body* body = &world->sol[i];
+		render->orbit_slot[i] = -1;
+		if (body->renderer != CBR_BODY || body->parent < 0) continue;
+		render->orbit_body[n_orbits] = i;
+		render->orbit_slot[i] = n_orbits++;
+	}
+	render->n_orbits = n_orbits;
+
+	// one more slot for clipped arcs
+	int rows = (n_orbits + 1 + ORBIT_TEXTURE_WIDTH - 1) / ORBIT_TEXTURE_WIDTH;
+	if (rows != render->orbit_texture_rows) {
+		render->orbit_texture_rows = rows;
+		AN(render->orbit_texels = realloc(render->orbit_texels, rows * ORBIT_TEXTURE_WIDTH * 4 * sizeof(float)));
+		memset(render->orbit_texels, 0, rows * ORBIT_TEXTURE_WIDTH * 4 * sizeof(float));
+		glBindTexture(GL_TEXTURE_2D, render->orbit_texture); CHKGL;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, ORBIT_TEXTURE_WIDTH, rows, 0, GL_RGBA, GL_FLOAT, render->orbit_texels); CHKGL;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); CHKGL;
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); CHKGL;
+	}
+	AN(render->orbit_draw_counts = realloc(render->orbit_draw_counts, (n_orbits + 1) * sizeof(GLsizei)));
+	AN(render->orbit_draw_offsets = realloc(render->orbit_draw_offsets, (n_orbits + 1) * sizeof(GLvoid*)));
+	if (n_orbits == 0) return;
+
+	float* vertices;
+	uint32_t* indices;
+	AN(vertices = malloc(n_orbits * ORBIT_VERTEX_FLOATS * sizeof(float)));
+	AN(indices = malloc(n_orbits * ORBIT_INDICES * sizeof(uint32_t)));
+	for (int i = 0; i < world->n_bodies; i++) {
+		int slot = render->orbit_slot[i];
+		if (slot < 0) continue;
+		float color[4];
+		orbit_color(&world->sol[i], color);
+		orbit_build(&world->sol[i], color, slot, &vertices[slot * ORBIT_VERTEX_FLOATS]);
+		orbit_build_indices(slot * ORBIT_VERTICES, &indices[slot * ORBIT_INDICES]);
+	}
 
-		float lx = -body->kepler_x;
-		float ly = -body->kepler_y;
-		float d = 1/sqrtf(lx*lx + ly*ly);
-		glUniform2f(render->body_u_light, lx*d, ly*d); CHKGL;
+	glBindBuffer(GL_ARRAY_BUFFER, render->orbit_vertex_buffer); CHKGL;
+	glBufferData(GL_ARRAY_BUFFER, n_orbits * ORBIT_VERTEX_FLOATS * sizeof(float), vertices, GL_STATIC_DRAW); CHKGL;
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->orbit_index_buffer); CHKGL;
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, n_orbits * ORBIT_INDICES * sizeof(uint32_t), indices, GL_STATIC_DRAW); CHKGL;
 
-		glUniform3f(
-			render->body_u_color,
-			body->color[0],
-			body->color[1],
-			body->color[2]); CHKGL;
-	}
+	free(indices);
+	free(vertices);
+}
 
-	glEnableVertexAttribArray(render->body_a_position); CHKGL;
-	glBindBuffer(GL_ARRAY_BUFFER, render->quad_vertex_buffer); CHKGL;
-	glVertexAttribPointer(render->body_a_position, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, 0); CHKGL;
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->quad_index_buffer); CHKGL;
-	glDrawElements(GL_QUADS, 4, GL_UNSIGNED_BYTE, NULL); CHKGL;
-	glDisableVertexAttribArray(render->body_a_position); CHKGL;
+static void orbit_attributes(struct render* render)
+{
+	size_t stride = sizeof(float) * ORBIT_FLOATS_PER_VERTEX;
+	glVertexAttribPointer(PATH_A_POSITION, 2, GL_FLOAT, GL_FALSE, stride, 0); CHKGL;
+	glVertexAttribPointer(PATH_A_NORMAL, 2, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float)*2)); CHKGL;
+	glVertexAttribPointer(PATH_A_UV, 2, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float)*4)); CHKGL;
+	glVertexAttribPointer(PATH_A_COLOR, 4, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float)*6)); CHKGL;
+	glVertexAttribPointer(PATH_A_SLOT, 1, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float)*10)); CHKGL;
 }
 
-void render_orbit(struct render* render, struct celestial_body* body)
+// all orbits in (at most) two draw calls: static levels of detail, then arcs
+void render_orbits(struct render* render, struct world* world)
 {
-	render_prim_reset(render);
-
-	float width = 6;
-
-	int N = 256;
-	float a = body->semi_major_axis_km;
-	float e = body->eccentricity;
-	float b =  a * sqrtf(1 - e*e);
-	for (int i = 0; i <= N; i++) {
-		float E = (float)(i%N)/(float)N*TAU;
-		float x,y,nx,ny;
-		calc_ellipse_position(E, e, a, b, body->longitude_of_periapsis_rad, &x, &y, &nx, &ny);
-
-		x = (body->parent->render_x + x * render->scale) / render->window_width * 2;
-		y = (body->parent->render_y + y * render->scale) / render->window_height * 2;
-
-		float dn = 1.0/sqrtf(nx*nx + ny*ny);
-		nx = nx * dn / render->window_width * 2 * width;
-		ny = ny * dn / render->window_height * 2 * width;
-
-		float Mx = (mean_anomaly_from_eccentric_anomaly((float)i/(float)N*TAU, e) / TAU) * 12.0;
-		float xs[] = {
-			x - nx, y - ny, Mx, -1,
-			x + nx, y + ny, Mx, 1
-		};
-		render_prim_vertex_data(render, xs, 8);
-
-		if (i<N) {
-			int i2 = i+1;
-			uint32_t idxs[] = {(i<<1), (i<<1)+1, (i2<<1)+1, (i2<<1)};
-			render_prim_index_data(render, idxs, 4);
+	render_orbits_sync(render, world);
+	if (render->n_orbits == 0) return;
+
+	struct orbit_arcs* arcs = &render->orbit_arcs;
+	arcs->n_vertices = 0;
+	arcs->n_runs = 0;
+	int n_draws = 0;
+
+	float hw = render->window_width * 0.5f;
+	float hh = render->window_height * 0.5f;
+	/* orbits are around their parents, so only those of visible bodies'
+	 * satellites can be on screen. walked by slot rather than through the
+	 * visible bodies' satellites, which would visit every minor body */
+	for (int slot = 0; slot < render->n_orbits; slot++) {
+		struct celestial_body* body = &world->sol[render->orbit_body[slot]];
+		if (world->visible_stamp[body->parent] != world->visible_frame) continue;
+		float parent_x = world->render_x[body->parent];
+		float parent_y = world->render_y[body->parent];
+
+		/* orbits entirely on screen use the static level of detail for
+		 * their size; others only draw their on-screen arcs */
+		float extent = body->semi_major_axis_km * (1 + body->eccentricity) * render->scale + ORBIT_WIDTH;
+		if (parent_x + extent < -hw || parent_x - extent > hw || parent_y + extent < -hh || parent_y - extent > hh) continue;
+		float* texel = &render->orbit_texels[slot * 4];
+		texel[0] = parent_x;
+		texel[1] = parent_y;
+		texel[2] = render->scale;
+		int lod = ORBIT_LODS;
+		if (parent_x - extent >= -hw && parent_x + extent <= hw && parent_y - extent >= -hh && parent_y + extent <= hh) {
+			lod = orbit_lod(body->semi_major_axis_km * render->scale);
+		}
+		if (lod < ORBIT_LODS) {
+			size_t first = (size_t)slot * ORBIT_INDICES + orbit_lod_first_index(lod);
+			render->orbit_draw_counts[n_draws] = orbit_lod_segments(lod) * 4;
+			render->orbit_draw_offsets[n_draws] = (char*)(first * sizeof(uint32_t));
+			n_draws++;
+		} else {
+			float color[4];
+			orbit_color(body, color);
+			orbit_clip(body, color, render->n_orbits, parent_x, parent_y, render->scale, render->window_width, render->window_height, render->orbit_arc_vertices, arcs);
 		}
 	}
+	{
+		float* texel = &render->orbit_texels[render->n_orbits * 4];
+		texel[0] = 0;
+		texel[1] = 0;
+		texel[2] = 1;
+	}
+	if (n_draws == 0 && arcs->n_runs == 0) return;
 
-	shader_use(&render->path_shader);
+	glActiveTexture(GL_TEXTURE0); CHKGL;
+	glBindTexture(GL_TEXTURE_2D, render->orbit_texture); CHKGL;
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ORBIT_TEXTURE_WIDTH, render->orbit_texture_rows, GL_RGBA, GL_FLOAT, render->orbit_texels); CHKGL;
 
+	struct shader* shader = shader_permutations_use(&render->path_shader, shader_key(render->path_shader.source, &aa_tier_values[render->aa]));
+	glUniform1i(shader->uniforms[PATH_U_ORBITS], 0); CHKGL;
+	glUniform2f(shader->uniforms[PATH_U_NDC], 2.0f / render->window_width, 2.0f / render->window_height); CHKGL;
+	glUniform2f(shader->uniforms[PATH_U_WIDTH], ORBIT_WIDTH * 2.0f / render->window_width, ORBIT_WIDTH * 2.0f / render->window_height); CHKGL;
 	{
 		float mux = 0.003f;
 		float muy = 0.1f;
-		glUniform2f(render->path_u_mu, mux, muy);
-
-		float grayd = 0.6;
-		float r = lerpf(grayd, body->color[0], 0.4);
-		float g = lerpf(grayd, body->color[1], 0.4);
-		float b = lerpf(grayd, body->color[2], 0.4);
-
-		glUniform4f(render->path_u_color1, r, g, b, 0.5f);
-	}
-
-	glEnableVertexAttribArray(render->path_a_position); CHKGL;
-	glEnableVertexAttribArray(render->path_a_uv); CHKGL;
-	glBindBuffer(GL_ARRAY_BUFFER, render->prim_vertex_buffer); CHKGL;
-	glBufferSubData(GL_ARRAY_BUFFER, 0, render->prim_vertex_n * sizeof(float), render->prim_vertex_data); CHKGL;
-	glVertexAttribPointer(render->path_a_position, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, 0); CHKGL;
-	glVertexAttribPointer(render->path_a_uv, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, (char*)(sizeof(float)*2)); CHKGL;
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->prim_index_buffer); CHKGL;
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, render->prim_index_n * sizeof(uint32_t), render->prim_index_data); CHKGL;
-	glDrawElements(GL_QUADS, render->prim_index_n, GL_UNSIGNED_INT, NULL); CHKGL;
-	glDisableVertexAttribArray(render->path_a_uv); CHKGL;
-	glDisableVertexAttribArray(render->path_a_position); CHKGL;
-}
+		glUniform2f(shader->uniforms[PATH_U_MU], mux, muy); CHKGL;
+	}
 
-void render_celestial_body(struct render* render, struct celestial_body* body)
-{
-	ASSERT(body->n_satellites == 0 || body->satellites != NULL);
-	for (int i = 0; i < body->n_satellites; i++) {
-		struct celestial_body* child = &body->satellites[i];
-		render_celestial_body(render, child);
-	}
-
-	switch (body->renderer) {
-		case CBR_SUN:
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
-			render_sun(render, body);
-			break;
-		case CBR_BODY:
-			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CHKGL;
-			render_orbit(render, body);
-			render_body(render, body);
-			break;
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CHKGL;
+	glEnableVertexAttribArray(PATH_A_POSITION); CHKGL;
+	glEnableVertexAttribArray(PATH_A_NORMAL); CHKGL;
+	glEnableVertexAttribArray(PATH_A_UV); CHKGL;
+	glEnableVertexAttribArray(PATH_A_COLOR); CHKGL;
+	glEnableVertexAttribArray(PATH_A_SLOT); CHKGL;
+
+	if (n_draws > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, render->orbit_vertex_buffer); CHKGL;
+		orbit_attributes(render);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->orbit_index_buffer); CHKGL;
+		glMultiDrawElements(GL_QUADS, render->orbit_draw_counts, GL_UNSIGNED_INT, render->orbit_draw_offsets, n_draws); CHKGL;
 	}
-}
 
-void render_world(struct render* render, struct world* world)
-{
-	SDL_GetWindowSize(render->window, &render->window_width, &render->window_height);
-	glViewport(0, 0, render->window_width, render->window_height);
+	if (arcs->n_runs > 0) {
+		glBindBuffer(GL_ARRAY_BUFFER, render->orbit_arc_vertex_buffer); CHKGL;
+		glBufferSubData(GL_ARRAY_BUFFER, 0, arcs->n_vertices * ORBIT_FLOATS_PER_VERTEX * sizeof(float), render->orbit_arc_vertices); CHKGL;
+		orbit_attributes(render);
+		GLsizei counts[ORBIT_ARC_MAX_RUNS];
+		const GLvoid* offsets[ORBIT_ARC_MAX_RUNS];
+		for (int i = 0; i < arcs->n_runs; i++) {
+			counts[i] = arcs->run_segments[i] * 4;
+			offsets[i] = (char*)((size_t)arcs->run_first[i] * 4 * sizeof(uint32_t));
+		}
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->orbit_arc_index_buffer); CHKGL;
+		glMultiDrawElements(GL_QUADS, counts, GL_UNSIGNED_INT, offsets, arcs->n_runs); CHKGL;
+	}
 
-	render_celestial_body(render, world->sol);
+	glDisableVertexAttribArray(PATH_A_SLOT); CHKGL;
+	glDisableVertexAttribArray(PATH_A_COLOR); CHKGL;
+	glDisableVertexAttribArray(PATH_A_UV); CHKGL;
+	glDisableVertexAttribArray(PATH_A_NORMAL); CHKGL;
+	glDisableVertexAttribArray(PATH_A_POSITION); CHKGL;
 }
 
-
-void _update_body_kepler_position_rec(
-	struct celestial_body* body,
-	struct celestial_body* parent,
-	float t,
-	float x, float y)
+// draws n instances of the unit quad from the instance buffer, starting at
+// instance first; the n_attributes QUAD_A_* after QUAD_A_POSITION take size[i]
+// floats of each
+static void render_quad_instances(struct render* render, const int* size, int n_attributes, int first, int n)
 {
-	if (parent != NULL) {
-		float dx, dy;
-		kepler_calc_relative_position(body, parent, t, &dx, &dy);
-		x += dx;
-		y += dy;
-		body->kepler_x = x;
-		body->kepler_y = y;
-	} else {
-		body->kepler_x = 0;
-		body->kepler_y = 0;
+	glEnableVertexAttribArray(QUAD_A_POSITION); CHKGL;
+	glBindBuffer(GL_ARRAY_BUFFER, render->quad_vertex_buffer); CHKGL;
+	glVertexAttribPointer(QUAD_A_POSITION, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, 0); CHKGL;
+
+	glBindBuffer(GL_ARRAY_BUFFER, render->body_instance_buffer); CHKGL;
+	size_t stride = sizeof(float) * BODY_INSTANCE_FLOATS;
+	size_t offset = first * stride;
+	for (int i = 0; i < n_attributes; i++) {
+		GLuint a = QUAD_A_POSITION + 1 + i;
+		glEnableVertexAttribArray(a); CHKGL;
+		glVertexAttribPointer(a, size[i], GL_FLOAT, GL_FALSE, stride, (char*)offset); CHKGL;
+		glVertexAttribDivisorARB(a, 1); CHKGL;
+		offset += size[i] * sizeof(float);
 	}
 
-	for (int i = 0; i < body->n_satellites; i++) {
-		struct celestial_body* child = &body->satellites[i];
-		_update_body_kepler_position_rec(child, body, t, x, y);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, render->quad_index_buffer); CHKGL;
+	glDrawElementsInstancedARB(GL_QUADS, 4, GL_UNSIGNED_BYTE, NULL, n); CHKGL;
+
+	for (int i = 0; i < n_attributes; i++) {
+		GLuint a = QUAD_A_POSITION + 1 + i;
+		glVertexAttribDivisorARB(a, 0); CHKGL;
+		glDisableVertexAttribArray(a); CHKGL;
 	}
+	glDisableVertexAttribArray(QUAD_A_POSITION); CHKGL;
 }
 
-void update_bodies_kepler_position(struct world* world)
+// all on-screen bodies in one instanced draw, then all suns in another
+void render_bodies(struct render* render, struct world* world)
 {
-	_update_body_kepler_position_rec(world->sol, NULL, world_t1(world), 0, 0);
-}
+	if (render->body_instance_max < world->n_bodies) {
+		render->body_instance_max = world->n_bodies;
+		AN(render->body_instance_data = realloc(render->body_instance_data, render->body_instance_max * BODY_INSTANCE_FLOATS * sizeof(float)));
+		glBindBuffer(GL_ARRAY_BUFFER, render->body_instance_buffer); CHKGL;
+		glBufferData(GL_ARRAY_BUFFER, render->body_instance_max * BODY_INSTANCE_FLOATS * sizeof(float), NULL, GL_STREAM_DRAW); CHKGL;
+	}
 
+	float hw = render->window_width * 0.5f;
+	float hh = render->window_height * 0.5f;
+	int n_bodies = 0;
+	int n_suns = 0;
+	for (int pass = 0; pass < 2; pass++) {
+		int renderer = pass == 0 ? CBR_BODY : CBR_SUN;
+		// deepest first, so that satellites are drawn below their parents
+		for (int k = world->n_visible - 1; k >= 0; k--) {
+			int i = world->visible[k];
+			if (world->renderer[i] != renderer) continue;
+			struct celestial_body* body = &world->sol[i];
+			float x = world->render_x[i];
+			float y = world->render_y[i];
+			float r = world->render_radius[i];
+			if (x + r < -hw || x - r > hw || y + r < -hh || y - r > hh) continue;
+
+			float* v = &render->body_instance_data[(n_bodies + n_suns) * BODY_INSTANCE_FLOATS];
+			v[0] = x;
+			v[1] = y;
+			v[2] = r;
+			if (renderer == CBR_BODY) {
+				float lx = -world->kepler.x[i];
+				float ly = -world->kepler.y[i];
+				float d = 1/sqrtf(lx*lx + ly*ly);
+				v[3] = lx*d;
+				v[4] = ly*d;
+				v[5] = body->color[0];
+				v[6] = body->color[1];
+				v[7] = body->color[2];
+				n_bodies++;
+			} else {
+				v[3] = v[4] = v[5] = v[6] = v[7] = 0;
+				n_suns++;
+			}
+		}
+	}
+	if (n_bodies + n_suns == 0) return;
 
+	glBindBuffer(GL_ARRAY_BUFFER, render->body_instance_buffer); CHKGL;
+	glBufferSubData(GL_ARRAY_BUFFER, 0, (n_bodies + n_suns) * BODY_INSTANCE_FLOATS * sizeof(float), render->body_instance_data); CHKGL;
 
-void _update_body_screen_position_rec(
-	struct celestial_body* body,
-	float scale,
-	float cx, float cy)
-{
-	body->render_x = (body->kepler_x - cx) * scale;
-	body->render_y = (body->kepler_y - cy) * scale;
+	float ndc_x = 2.0f / render->window_width;
+	float ndc_y = 2.0f / render->window_height;
 
-	float actual_radius = body->radius_km * scale;
-	body->render_radius = actual_radius > body->mock_radius ? actual_radius : body->mock_radius;
+	if (n_bodies > 0) {
+		struct shader* shader = shader_permutations_use(&render->body_shader, shader_key(render->body_shader.source, &aa_tier_values[render->aa]));
+		glUniform2f(shader->uniforms[QUAD_U_NDC], ndc_x, ndc_y); CHKGL;
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CHKGL;
+		int sizes[] = {3, 2, 3}; // a_body, a_light, a_color
+		render_quad_instances(render, sizes, 3, 0, n_bodies);
+	}
 
-	for (int i = 0; i < body->n_satellites; i++) {
-		struct celestial_body* child = &body->satellites[i];
-		_update_body_screen_position_rec(child, scale, cx, cy);
+	if (n_suns > 0) {
+		struct shader* shader = shader_permutations_use(&render->sun_shader, shader_key(render->sun_shader.source, &aa_tier_values[render->aa]));
+		glUniform2f(shader->uniforms[QUAD_U_NDC], ndc_x, ndc_y); CHKGL;
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE); CHKGL;
+		int sizes[] = {3}; // a_body
+		render_quad_instances(render, sizes, 1, n_bodies, n_suns);
 	}
 }
 
-void update_bodies_screen_position(struct render* render, struct world* world, struct observer* observer)
+void render_points(struct render* render, struct world* world)
 {
-	_update_body_screen_position_rec(
-		world->sol,
-		render->scale,
-		observer->cx, observer->cy
-	);
+	int n = 0;
+	for (int k = 0; k < world->n_visible; k++) {
+		int i = world->visible[k];
+		if (world->renderer[i] != CBR_POINT) continue;
+		float x = world->render_x[i] / render->window_width * 2;
+		float y = world->render_y[i] / render->window_height * 2;
+		if (x < -1 || x > 1 || y < -1 || y > 1) continue;
+		if (n*2 >= render->point_vertex_max) {
+			render->point_vertex_max = render->point_vertex_max ? render->point_vertex_max * 2 : 65536;
+			AN(render->point_vertex_data = realloc(render->point_vertex_data, render->point_vertex_max * sizeof(float)));
+		}
+		render->point_vertex_data[n*2] = x;
+		render->point_vertex_data[n*2+1] = y;
+		n++;
+	}
+	if (n == 0) return;
+
+	shader_use(&render->point_shader);
+	glUniform4f(render->point_u_color, 0.5, 0.5, 0.45, 0.6); CHKGL;
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE); CHKGL;
+	glEnableVertexAttribArray(render->point_a_position); CHKGL;
+	glBindBuffer(GL_ARRAY_BUFFER, render->point_vertex_buffer); CHKGL;
+	glBufferData(GL_ARRAY_BUFFER, n * 2 * sizeof(float), render->point_vertex_data, GL_STREAM_DRAW); CHKGL;
+	glVertexAttribPointer(render->point_a_position, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 2, 0); CHKGL;
+	glDrawArrays(GL_POINTS, 0, n); CHKGL;
+	glDisableVertexAttribArray(render->point_a_position); CHKGL;
+}
+
+void render_world(struct render* render, struct world* world)
+{
+	SDL_GetWindowSize(render->window, &render->window_width, &render->window_height);
+	glViewport(0, 0, render->window_width, render->window_height);
+
+	PROF_GPU_BEGIN(PROF_GPU_POINTS);
+	render_points(render, world);
+	PROF_GPU_END(PROF_GPU_POINTS);
+	PROF_GPU_BEGIN(PROF_GPU_ORBITS);
+	render_orbits(render, world);
+	PROF_GPU_END(PROF_GPU_ORBITS);
+	PROF_GPU_BEGIN(PROF_GPU_BODIES);
+	render_bodies(render, world);
+	PROF_GPU_END(PROF_GPU_BODIES);
 }
 
 
@@ -486,7 +596,7 @@ void _render_time(struct render* render, struct world* world, int64_t t)
 	text_printf(tx, "%04d-%02d-%02d %02d:%02d:%02d", year, month, day, hour, minute, second);
 }
 
-void render_time(struct render* render, struct world* world, int64_t dt60)
+void render_time(struct render* render, struct world* world, struct simclock* clock, int64_t dt60)
 {
 	int N = 10;
 
@@ -503,38 +613,102 @@ void render_time(struct render* render, struct world* world, int64_t dt60)
 		int64_t t = (world->t60 + i*dt60/(N/3)) / 60;
 		if (t>=0) _render_time(render, world, t);
 	}
-}
 
-struct celestial_body* _find_body_at_screen_position_rec(struct render* render, struct celestial_body* body, int x, int y)
-{
-	float dx = (float)x - body->render_x - render->window_width/2;
-	float dy = (float)y + body->render_y - render->window_height/2;
-	float d = sqrtf(dx*dx + dy*dy);
-
-	if (d < body->render_radius) {
-		return body;
+	text_set_color3f(tx, 0.8, 1, 1);
+	text_set_cursor(tx, 16, render->window_height - 16 - 2*24);
+	if (clock->paused) {
+		text_printf(tx, "paused");
+	} else {
+		text_printf(tx, "x%g%s", clock->warp, world->use_nbody ? " n-body" : "");
+		// n-body steps being dropped
+		if (fabs(clock->dropped_warp) > fabs(clock->warp) * 0.01) text_printf(tx, " (x%.3g effective)", clock->warp - clock->dropped_warp);
 	}
+	if (render->aa != AA_HIGH) text_printf(tx, " aa %s", aa_tier_names[render->aa]);
+}
 
-	for (int i = 0; i < body->n_satellites; i++) {
-		struct celestial_body* found = _find_body_at_screen_position_rec(render, &body->satellites[i], x, y);
-		if (found != NULL) return found;
-	}
+#define EPHEM_MAX_BYTES (64<<20)
+// F4 dumps to this in $TMPDIR (or /tmp) without -t; the working directory
+// may not be writable
+#define TRACE_DEFAULT_NAME "yearone-trace.json"
 
-	return NULL;
-}
+// simulated seconds per wall second at startup (~100000/60 per frame at 60Hz)
+#define DEFAULT_WARP (100000.0)
+// step length when nothing integrates; positions are then evaluated at the
+// render time, so it only has to keep the step count low
+#define ANALYTIC_STEP60 (60*60*60)
+// n-body steps are costly; beyond this many per frame, time is dropped
+#define NBODY_MAX_STEPS (8)
 
-struct celestial_body* find_body_at_screen_position(struct render* render, struct world* world, int x, int y)
+static void usage(const char* prg)
 {
-	return _find_body_at_screen_position_rec(render, world->sol, x, y);
+	fprintf(stderr, "usage: %s [-b <body catalog>] [-c <MPCORB.DAT>] [-e <ephemeris cache>] [-j <threads>] [-t <trace.json>] [-a fast|medium|high] [-s <shader cache dir>]\n", prg);
+	exit(EXIT_FAILURE);
 }
 
 int main(int argc, char** argv)
 {
-	struct celestial_body* sol = mksol();
+	const char* ephem_path = NULL;
+	const char* catalog_path = NULL;
+	const char* mpc_path = NULL;
+	int n_threads = SDL_GetCPUCount();
+	const char* trace_path = NULL;
+	int aa = AA_HIGH;
+	const char* shader_cache_dir = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-e") == 0 && i+1 < argc) {
+			ephem_path = argv[++i];
+		} else if (strcmp(argv[i], "-b") == 0 && i+1 < argc) {
+			catalog_path = argv[++i];
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+			mpc_path = argv[++i];
+		} else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+			n_threads = atoi(argv[++i]);
+			if (n_threads < 1) usage(argv[0]);
+		} else if (strcmp(argv[i], "-t") == 0 && i+1 < argc) {
+			trace_path = argv[++i];
+		} else if (strcmp(argv[i], "-a") == 0 && i+1 < argc) {
+			i++;
+			for (aa = 0; aa < AA_N && strcmp(argv[i], aa_tier_names[aa]) != 0; aa++) {}
+			if (aa == AA_N) usage(argv[0]);
+		} else if (strcmp(argv[i], "-s") == 0 && i+1 < argc) {
+			shader_cache_dir = argv[++i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+
+	int n_bodies = 0;
+	// cheap enough to leave on; F4 (or exit, with -t) dumps the last events
+	char trace_hotkey_path[4096];
+	if (trace_path != NULL) {
+		snprintf(trace_hotkey_path, sizeof(trace_hotkey_path), "%s", trace_path);
+	} else {
+		const char* tmp = getenv("TMPDIR");
+		snprintf(trace_hotkey_path, sizeof(trace_hotkey_path), "%s/%s", tmp != NULL && tmp[0] != 0 ? tmp : "/tmp", TRACE_DEFAULT_NAME);
+	}
+	trace_enabled = 1;
+	trace_set_thread_name("main");
+
+	pool_init(n_threads);
+
+	struct celestial_body* sol = NULL;
+	if (catalog_path != NULL) {
+		sol = catalog_map(catalog_path, &n_bodies);
+		if (sol == NULL) arghf("%s: not a version %d body catalog (make one with mkcatalog)", catalog_path, CATALOG_VERSION);
+	} else {
+		sol = mksol(&n_bodies);
+	}
+	if (mpc_path != NULL) {
+		struct celestial_body* planets = sol;
+		sol = mpc_load(mpc_path, planets, &n_bodies, n_threads);
+		if (catalog_path == NULL) free(planets); // catalogs stay mapped
+	}
 
 	SAZ(SDL_Init(SDL_INIT_VIDEO));
 	atexit(SDL_Quit);
 
+	glcheck_context_attributes();
+
 	SDL_Window* window = SDL_CreateWindow(
 		"year one",
 		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
@@ -555,12 +729,16 @@ int main(int argc, char** argv)
 			arghf("glewInit() failed: %s", glewGetErrorString(err));
 		}
 
+		glcheck_init();
+
 		#define CHECK_GL_EXT(x) { if(!GLEW_ ## x) arghf("OpenGL extension not found: " #x); }
 		CHECK_GL_EXT(ARB_shader_objects);
 		CHECK_GL_EXT(ARB_vertex_shader);
 		CHECK_GL_EXT(ARB_fragment_shader);
 		CHECK_GL_EXT(ARB_framebuffer_object);
 		CHECK_GL_EXT(ARB_vertex_buffer_object);
+		CHECK_GL_EXT(ARB_draw_instanced);
+		CHECK_GL_EXT(ARB_instanced_arrays);
 		#undef CHECK_GL_EXT
 
 		/* to figure out what extension something belongs to, see:
@@ -568,6 +746,8 @@ int main(int argc, char** argv)
 
 		// XXX check that version is at least 1.30?
 		// printf("GLSL version %s\n", glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+		shader_cache_init(shader_cache_dir);
 	}
 
 	glDisable(GL_DEPTH_TEST); CHKGL;
@@ -578,17 +758,27 @@ int main(int argc, char** argv)
 	//glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); CHKGL;
 
 	fonts_init();
+	PROF_INIT();
 
 	struct render render;
-	render_init(&render, window);
+	render_init(&render, window, aa);
 
 	struct world world;
-	world_init(&world, sol);
+	world_init(&world, sol, n_bodies);
+	if (ephem_path != NULL) {
+		world.use_ephem = 1;
+		ephem_init(&world.ephem, sol, n_bodies, EPHEM_MAX_BYTES);
+		ephem_load(&world.ephem, ephem_path);
+	}
+
+	struct simclock clock;
+	simclock_init(&clock, world.t60, ANALYTIC_STEP60, SIMCLOCK_UNCAPPED, DEFAULT_WARP);
+	uint64_t counter = SDL_GetPerformanceCounter();
 
 	struct observer observer;
 	observer_init(&observer);
 
-	observer.cbody = sol;
+	observer.cbody = 0;
 	observer.height_km = observer.height_km_target = 3e8;
 
 	SDL_Cursor* arrow_cursor = SDL_CreateSystemCursor(SDL_SYSTEM_CURSOR_ARROW);
@@ -599,6 +789,7 @@ int main(int argc, char** argv)
 	while (!exiting) {
 		int clicked = 0;
 
+		PROF_BEGIN(PROF_EVENTS);
 		SDL_Event e;
 		while (SDL_PollEvent(&e)) {
 			switch (e.type) {
@@ -607,6 +798,43 @@ int main(int argc, char** argv)
 					break;
 				case SDL_KEYDOWN:
 					if (e.key.keysym.sym == SDLK_ESCAPE) exiting = 1;
+					switch (e.key.keysym.sym) {
+						case SDLK_n:
+							// the integrator steps on the clock's steps
+							world.t60 = simclock_render_t60(&clock);
+							world_set_nbody(&world, !world.use_nbody);
+							if (world.use_nbody) {
+								simclock_set_step(&clock, world.nbody.step60, NBODY_MAX_STEPS);
+							} else {
+								simclock_set_step(&clock, ANALYTIC_STEP60, SIMCLOCK_UNCAPPED);
+							}
+							break;
+						case SDLK_SPACE:
+							clock.paused = !clock.paused;
+							break;
+						case SDLK_PERIOD:
+							if (clock.paused) simclock_step(&clock);
+							break;
+						case SDLK_PLUS:
+						case SDLK_EQUALS:
+							clock.warp *= 2;
+							break;
+						case SDLK_MINUS:
+							clock.warp /= 2;
+							break;
+						case SDLK_r:
+							clock.warp = -clock.warp;
+							break;
+						case SDLK_F3:
+							PROF_TOGGLE();
+							break;
+						case SDLK_F4:
+							if (trace_dump(trace_hotkey_path) == 0) printf("trace written to %s\n", trace_hotkey_path);
+							break;
+						case SDLK_F5:
+							render.aa = (render.aa + 1) % AA_N;
+							break;
+					}
 					break;
 				case SDL_MOUSEWHEEL:
 					observer.height_km_target *= powf(0.95, e.wheel.y);
@@ -616,6 +844,7 @@ int main(int argc, char** argv)
 					break;
 			}
 		}
+		PROF_END(PROF_EVENTS);
 
 		int mx = 0;
 		int my = 0;
@@ -626,31 +855,63 @@ int main(int argc, char** argv)
 		glClearColor(0,0,0,1);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		int64_t dt60 = 100000;
-		world.t60 += dt60;
-		render_time(&render, &world, dt60);
-
+		uint64_t now = SDL_GetPerformanceCounter();
+		double dt = (double)(now - counter) / (double)SDL_GetPerformanceFrequency();
+		counter = now;
+		simclock_advance(&clock, dt);
+		int64_t t60 = simclock_render_t60(&clock);
+		int64_t dt60 = t60 - world.t60;
+		world.t60 = t60;
+		render_time(&render, &world, &clock, dt60);
+		PROF_DRAW(&render.text, 16, 16);
+
+		PROF_BEGIN(PROF_TEXT);
+		PROF_GPU_BEGIN(PROF_GPU_TEXT);
 		text_flush(&render.text);
-
-		update_bodies_kepler_position(&world);
-		observer.cx = observer.cbody->kepler_x;
-		observer.cy = observer.cbody->kepler_y;
+		PROF_GPU_END(PROF_GPU_TEXT);
+		PROF_END(PROF_TEXT);
+
+		PROF_BEGIN(PROF_POSITIONS);
+		world_update_positions(&world);
+		PROF_END(PROF_POSITIONS);
+		observer.cx = world.kepler.x[observer.cbody];
+		observer.cy = world.kepler.y[observer.cbody];
 		render.scale = (float)render.window_height / observer.height_km;
-		update_bodies_screen_position(&render, &world, &observer);
-
-		struct celestial_body* hover = find_body_at_screen_position(&render, &world, mx, my);
-		if (hover != NULL) {
+		PROF_BEGIN(PROF_SCREEN);
+		world_update_screen_positions(&world, render.scale, observer.cx, observer.cy, render.window_width/2 + ORBIT_WIDTH, render.window_height/2 + ORBIT_WIDTH);
+		PROF_END(PROF_SCREEN);
+
+		PROF_BEGIN(PROF_PICK);
+		int hover = world_find_body_at(&world, mx - render.window_width/2, render.window_height/2 - my);
+		PROF_END(PROF_PICK);
+		if (hover >= 0) {
 			SDL_SetCursor(click_cursor);
 			if (clicked) observer.cbody = hover;
 		} else {
 			SDL_SetCursor(arrow_cursor);
 		}
 
+		PROF_BEGIN(PROF_RENDER);
 		render_world(&render, &world);
+		PROF_END(PROF_RENDER);
 
+		PROF_BEGIN(PROF_SWAP);
 		SDL_GL_SwapWindow(window);
+		PROF_END(PROF_SWAP);
+
+		glcheck_frame();
+		PROF_FRAME();
 	}
 
+	if (world.use_ephem) {
+		ephem_save(&world.ephem, ephem_path);
+		ephem_free(&world.ephem);
+	}
+
+	if (trace_path != NULL) trace_dump(trace_path);
+
+	pool_shutdown();
+
 	SDL_GL_DeleteContext(glctx);
 	SDL_DestroyWindow(window);
 
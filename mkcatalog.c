@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "a.h"
+#include "sol.h"
+#include "mpc.h"
+#include "catalog.h"
+
+/* mkcatalog: writes the bodies of sol.c, plus those of any MPCORB.DAT style
+ * files given, to a binary catalog (see catalog.h) */
+
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <out.cat> [MPCORB.DAT ...]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int n_bodies = 0;
+	struct celestial_body* bodies = mksol(&n_bodies);
+	for (int i = 2; i < argc; i++) {
+		struct celestial_body* old = bodies;
+		bodies = mpc_load(argv[i], old, &n_bodies, sysconf(_SC_NPROCESSORS_ONLN));
+		free(old);
+	}
+
+	catalog_write(argv[1], bodies, n_bodies);
+	printf("%s: %d bodies\n", argv[1], n_bodies);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,319 @@
+#define _XOPEN_SOURCE 700
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "a.h"
+#include "m.h"
+#include "mud.h"
+#include "sol.h"
+#include "mpc.h"
+
+/*
+https://minorplanetcenter.net/iau/info/MPOrbitFormat.html
+https://minorplanetcenter.net/iau/info/PackedDates.html
+*/
+
+#define MIN_LINE_LENGTH (103) // up to and including the semi-major axis
+#define NAME_COL (166)
+#define NAME_WIDTH (28)
+#define MAX_THREADS (64)
+
+#define J2000_JD (2451545.0)
+#define ALBEDO (0.14) // typical; only used for radius_km
+
+struct chunk {
+	const char* begin;
+	const char* end;
+
+	// first pass
+	int n_lines;
+	size_t n_chars;
+
+	// second pass
+	struct celestial_body* bodies; // root is bodies[0]
+	int first; // parsed bodies go to bodies[first+n_loaded]
+	char* chars;
+	uint32_t name; // offset of chars in sol_names
+	int n_loaded;
+};
+
+static const char* next_line(const char* p, const char* end, int* lenp)
+{
+	const char* eol = memchr(p, '\n', end - p);
+	if (eol == NULL) eol = end;
+	int len = eol - p;
+	if (len > 0 && p[len-1] == '\r') len--;
+	*lenp = len;
+	return eol < end ? eol + 1 : end;
+}
+
+static int trim(const char* s, int n, const char** startp)
+{
+	while (n > 0 && *s == ' ') { s++; n--; }
+	while (n > 0 && s[n-1] == ' ') n--;
+	*startp = s;
+	return n;
+}
+
+// readable designation if present, otherwise the packed one
+static int line_name(const char* line, int len, const char** namep)
+{
+	if (len > NAME_COL) {
+		int w = len - NAME_COL < NAME_WIDTH ? len - NAME_COL : NAME_WIDTH;
+		int n = trim(line + NAME_COL, w, namep);
+		if (n > 0) return n;
+	}
+	return trim(line, 7, namep);
+}
+
+/* fixed-width decimal ("  -12.345"); 1-based column, like the format
+ * description. NAN if blank or malformed. strtod() is several times slower
+ * and dominates the load time */
+static double field(const char* line, int col, int width)
+{
+	const char* p = line + col - 1;
+	const char* end = p + width;
+	while (p < end && *p == ' ') p++;
+	int neg = 0;
+	if (p < end && (*p == '-' || *p == '+')) neg = *p++ == '-';
+
+	int64_t mantissa = 0;
+	int n_digits = 0;
+	int n_decimals = -1;
+	for (; p < end && *p != ' '; p++) {
+		if (*p >= '0' && *p <= '9') {
+			mantissa = mantissa * 10 + (*p - '0');
+			n_digits++;
+			if (n_decimals >= 0) n_decimals++;
+		} else if (*p == '.' && n_decimals < 0) {
+			n_decimals = 0;
+		} else {
+			return NAN;
+		}
+	}
+	while (p < end && *p == ' ') p++;
+	if (p != end || n_digits == 0 || n_digits > 18) return NAN;
+
+	static const double pow10[] = {1, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+	double v = (double)mantissa;
+	if (n_decimals > 0) v /= pow10[n_decimals];
+	return neg ? -v : v;
+}
+
+static int packed_digit(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'V') return c - 'A' + 10;
+	return -1;
+}
+
+// packed epoch (e.g. "K249V" for 2024-09-31) to Julian date at 0h
+static double packed_epoch_jd(const char* s)
+{
+	int century = s[0] == 'I' ? 18 : s[0] == 'J' ? 19 : s[0] == 'K' ? 20 : -1;
+	int yy = (s[1] - '0') * 10 + (s[2] - '0');
+	int month = packed_digit(s[3]);
+	int day = packed_digit(s[4]);
+	if (century < 0 || yy < 0 || yy > 99 || month < 1 || month > 12 || day < 1) return NAN;
+	int y = century * 100 + yy;
+
+	// Fliegel & Van Flandern
+	int a = (14 - month) / 12;
+	int yr = y + 4800 - a;
+	int m = month + 12*a - 3;
+	int jdn = day + (153*m + 2)/5 + 365*yr + yr/4 - yr/100 + yr/400 - 32045;
+	return jdn - 0.5;
+}
+
+static int parse_line(struct chunk* chunk, const char* line, int len)
+{
+	int i = chunk->first + chunk->n_loaded;
+	struct celestial_body* body = &chunk->bodies[i];
+	double H = field(line, 9, 5);
+	double M_deg = field(line, 27, 9);
+	double peri_deg = field(line, 38, 9);
+	double node_deg = field(line, 49, 9);
+	double e = field(line, 71, 9);
+	double a_au = field(line, 93, 11);
+	double epoch = packed_epoch_jd(line + 20);
+
+	if (isnan(M_deg) || isnan(peri_deg) || isnan(node_deg) || isnan(e) || isnan(a_au) || isnan(epoch)) return 0;
+	if (e < 0 || e >= 1 || a_au <= 0) return 0;
+
+	double a = a_au * AU_IN_KM;
+	double lop = DEG2RAD((node_deg + peri_deg));
+	double n = sqrt(G * (double)chunk->bodies[0].mass_kg / (a*a*a));
+	double M = DEG2RAD(M_deg) - fmod(n * (epoch - J2000_JD) * 86400.0, TAU);
+
+	const char* name;
+	int name_len = line_name(line, len, &name);
+	body->name = chunk->name;
+	memcpy(chunk->chars, name, name_len);
+	chunk->chars[name_len] = 0;
+	chunk->chars += name_len + 1;
+	chunk->name += name_len + 1;
+
+	body->semi_major_axis_km = a;
+	body->eccentricity = e;
+	body->longitude_of_periapsis_rad = lop;
+	body->mean_longitude_j2000_rad = fmod(M + lop, TAU);
+	celestial_body_compute_derived(chunk->bodies, i);
+
+	// diameter from absolute magnitude
+	body->radius_km = isnan(H) ? 1 : 0.5 * 1329.0 / sqrt(ALBEDO) * pow(10, -H/5);
+	body->renderer = CBR_POINT;
+	body->mock_radius = 1;
+	body->color[0] = 0.5;
+	body->color[1] = 0.5;
+	body->color[2] = 0.45;
+
+	return 1;
+}
+
+static void* count_thread(void* arg)
+{
+	struct chunk* chunk = arg;
+	const char* p = chunk->begin;
+	while (p < chunk->end) {
+		int len;
+		const char* line = p;
+		p = next_line(p, chunk->end, &len);
+		if (len < MIN_LINE_LENGTH) continue;
+		const char* name;
+		chunk->n_lines++;
+		chunk->n_chars += line_name(line, len, &name) + 1;
+	}
+	return NULL;
+}
+
+static void* parse_thread(void* arg)
+{
+	struct chunk* chunk = arg;
+	const char* p = chunk->begin;
+	while (p < chunk->end) {
+		int len;
+		const char* line = p;
+		p = next_line(p, chunk->end, &len);
+		if (len < MIN_LINE_LENGTH) continue;
+		chunk->n_loaded += parse_line(chunk, line, len);
+	}
+	return NULL;
+}
+
+static void run_threads(void* (*fn)(void*), struct chunk* chunks, int n)
+{
+	pthread_t threads[MAX_THREADS];
+	for (int i = 0; i < n; i++) {
+		int err = pthread_create(&threads[i], NULL, fn, &chunks[i]);
+		if (err != 0) arghf("pthread_create: %s", strerror(err));
+	}
+	for (int i = 0; i < n; i++) AZ(pthread_join(threads[i], NULL));
+}
+
+struct celestial_body* mpc_load(const char* path, struct celestial_body* bodies, int* n_bodiesp, int n_threads)
+{
+	double t0 = now();
+
+	int fd = mud_open(path);
+	struct stat st;
+	if (fstat(fd, &st) == -1) arghf("fstat(%s): %s", path, strerror(errno));
+	size_t size = st.st_size;
+	if (size == 0) {
+		mud_close(fd);
+		return bodies;
+	}
+	const char* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) arghf("mmap(%s): %s", path, strerror(errno));
+	posix_madvise((void*)data, size, POSIX_MADV_SEQUENTIAL);
+	const char* end = data + size;
+
+	// MPCORB.DAT has a header that ends with a line of dashes
+	const char* begin = data;
+	for (const char* p = data; p < end && p < data + 65536; ) {
+		int len;
+		const char* line = p;
+		p = next_line(p, end, &len);
+		if (len >= 5 && memcmp(line, "-----", 5) == 0) {
+			begin = p;
+			break;
+		}
+	}
+
+	if (n_threads < 1) n_threads = 1;
+	if (n_threads > MAX_THREADS) n_threads = MAX_THREADS;
+	struct chunk chunks[MAX_THREADS];
+	memset(chunks, 0, sizeof(chunks));
+	const char* p = begin;
+	for (int i = 0; i < n_threads; i++) {
+		const char* q = i == n_threads-1 ? end : begin + (end - begin) * (i+1) / n_threads;
+		if (q < p) q = p;
+		if (q < end) {
+			const char* eol = memchr(q, '\n', end - q);
+			q = eol != NULL ? eol + 1 : end;
+		}
+		chunks[i].begin = p;
+		chunks[i].end = q;
+		p = q;
+	}
+
+	run_threads(count_thread, chunks, n_threads);
+
+	int n_lines = 0;
+	size_t n_chars = 0;
+	for (int i = 0; i < n_threads; i++) {
+		n_lines += chunks[i].n_lines;
+		n_chars += chunks[i].n_chars;
+	}
+
+	uint32_t name;
+	char* chars = sol_names_reserve(n_chars, &name);
+
+	int first;
+	bodies = sol_insert_satellites(bodies, n_bodiesp, 0, n_lines, CBC_MINOR, &first);
+	int at = first;
+	for (int i = 0; i < n_threads; i++) {
+		chunks[i].bodies = bodies;
+		chunks[i].first = at;
+		chunks[i].chars = chars;
+		chunks[i].name = name;
+		at += chunks[i].n_lines;
+		chars += chunks[i].n_chars;
+		name += chunks[i].n_chars;
+	}
+
+	run_threads(parse_thread, chunks, n_threads);
+
+	// close gaps left by lines that did not parse
+	int n_loaded = 0;
+	for (int i = 0; i < n_threads; i++) {
+		struct chunk* c = &chunks[i];
+		if (c->first != first + n_loaded) {
+			memmove(&bodies[first + n_loaded], &bodies[c->first], c->n_loaded * sizeof(struct celestial_body));
+		}
+		n_loaded += c->n_loaded;
+	}
+	sol_remove_satellites(bodies, n_bodiesp, 0, n_lines - n_loaded);
+	sol_elements_generation++;
+
+	munmap((void*)data, size);
+	mud_close(fd);
+
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	printf("%s: %d bodies (%d lines skipped) in %.0f ms with %d threads; peak RSS %ld MB\n",
+		path, n_loaded, n_lines - n_loaded, (now() - t0) * 1e3, n_threads, ru.ru_maxrss / 1024);
+
+	return bodies;
+}
@@ -0,0 +1,15 @@
+#ifndef MPC_H
+#define MPC_H
+
+#include "sol.h"
+
+/* loads minor bodies from a file in the Minor Planet Center's MPCORB.DAT
+ * column format and attaches them as CBC_MINOR satellites of the root of
+ * bodies. the file is parsed in place (mmap) by n_threads threads.
+ * elements are projected onto the ecliptic (inclination is ignored) and
+ * propagated back from their epoch to J2000. returns a new body array;
+ * like sol_insert_satellites(), bodies stays the caller's and indices after
+ * the root's satellites shift */
+struct celestial_body* mpc_load(const char* path, struct celestial_body* bodies, int* n_bodiesp, int n_threads);
+
+#endif/*MPC_H*/
@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "a.h"
+#include "m.h"
+#include "kepler.h"
+#include "pool.h"
+#include "trace.h"
+#include "nbody.h"
+
+#define LEAF_BODIES (8)
+#define MAX_DEPTH (48)
+#define SOFTENING_KM2 (1.0)
+#define TASK_BODIES (512)
+
+static int new_nodes(struct nbody* nb, int n)
+{
+	if (nb->n_nodes + n > nb->max_nodes) {
+		nb->max_nodes = (nb->n_nodes + n) * 2;
+		AN(nb->nodes = realloc(nb->nodes, nb->max_nodes * sizeof(struct nbody_node)));
+	}
+	int first = nb->n_nodes;
+	nb->n_nodes += n;
+	return first;
+}
+
+// moves massive[i0;i1) with coord < mid to the front; returns the split
+static int partition(struct nbody* nb, int i0, int i1, const double* coord, double mid)
+{
+	int* m = nb->massive;
+	int lo = i0;
+	int hi = i1 - 1;
+	for (;;) {
+		while (lo <= hi && coord[m[lo]] < mid) lo++;
+		while (lo <= hi && coord[m[hi]] >= mid) hi--;
+		if (lo > hi) return lo;
+		int tmp = m[lo];
+		m[lo] = m[hi];
+		m[hi] = tmp;
+	}
+}
+
+static void build(struct nbody* nb, int node, int i0, int i1, double bx, double by, double size, int depth)
+{
+	struct nbody_node* nd = &nb->nodes[node];
+	nd->size = size;
+	nd->i0 = i0;
+	nd->i1 = i1;
+	nd->child = -1;
+
+	if (i1 - i0 <= LEAF_BODIES || depth >= MAX_DEPTH) {
+		double gm = 0, cx = 0, cy = 0;
+		for (int k = i0; k < i1; k++) {
+			int j = nb->massive[k];
+			gm += nb->gm[j];
+			cx += nb->gm[j] * nb->x[j];
+			cy += nb->gm[j] * nb->y[j];
+		}
+		nd->gm = gm;
+		nd->cx = gm > 0 ? cx / gm : bx;
+		nd->cy = gm > 0 ? cy / gm : by;
+		return;
+	}
+
+	double h = size * 0.5;
+	int sx = partition(nb, i0, i1, nb->x, bx + h);
+	int sy0 = partition(nb, i0, sx, nb->y, by + h);
+	int sy1 = partition(nb, sx, i1, nb->y, by + h);
+
+	int child = new_nodes(nb, 4);
+	build(nb, child + 0, i0, sy0, bx, by, h, depth + 1);
+	build(nb, child + 1, sy0, sx, bx, by + h, h, depth + 1);
+	build(nb, child + 2, sx, sy1, bx + h, by, h, depth + 1);
+	build(nb, child + 3, sy1, i1, bx + h, by + h, h, depth + 1);
+
+	// new_nodes() may have moved the array
+	nd = &nb->nodes[node];
+	nd->child = child;
+	double gm = 0, cx = 0, cy = 0;
+	for (int c = 0; c < 4; c++) {
+		struct nbody_node* cn = &nb->nodes[child + c];
+		gm += cn->gm;
+		cx += cn->gm * cn->cx;
+		cy += cn->gm * cn->cy;
+	}
+	nd->gm = gm;
+	nd->cx = gm > 0 ? cx / gm : bx + h;
+	nd->cy = gm > 0 ? cy / gm : by + h;
+}
+
+static void build_tree(struct nbody* nb)
+{
+	nb->n_nodes = 0;
+	if (nb->n_massive == 0) return;
+
+	double x0 = INFINITY, y0 = INFINITY, x1 = -INFINITY, y1 = -INFINITY;
+	for (int k = 0; k < nb->n_massive; k++) {
+		int j = nb->massive[k];
+		if (nb->x[j] < x0) x0 = nb->x[j];
+		if (nb->y[j] < y0) y0 = nb->y[j];
+		if (nb->x[j] > x1) x1 = nb->x[j];
+		if (nb->y[j] > y1) y1 = nb->y[j];
+	}
+	double size = (x1 - x0 > y1 - y0 ? x1 - x0 : y1 - y0) * 1.001 + 1.0;
+
+	build(nb, new_nodes(nb, 1), 0, nb->n_massive, x0, y0, size, 0);
+}
+
+static void accelerate(struct nbody* nb, int i)
+{
+	const struct nbody_node* nodes = nb->nodes;
+	double px = nb->x[i];
+	double py = nb->y[i];
+	double theta2 = nb->theta * nb->theta;
+	double ax = 0, ay = 0;
+
+	int stack[3 * MAX_DEPTH + 4];
+	int sp = 0;
+	if (nb->n_nodes > 0) stack[sp++] = 0;
+	while (sp > 0) {
+		const struct nbody_node* nd = &nodes[stack[--sp]];
+		if (nd->gm == 0) continue;
+
+		if (nd->child < 0) {
+			for (int k = nd->i0; k < nd->i1; k++) {
+				int j = nb->massive[k];
+				if (j == i) continue;
+				double dx = nb->x[j] - px;
+				double dy = nb->y[j] - py;
+				double d2 = dx*dx + dy*dy + SOFTENING_KM2;
+				double s = nb->gm[j] / (d2 * sqrt(d2));
+				ax += dx * s;
+				ay += dy * s;
+			}
+			continue;
+		}
+
+		double dx = nd->cx - px;
+		double dy = nd->cy - py;
+		double d2 = dx*dx + dy*dy;
+		if (nd->size * nd->size < theta2 * d2) {
+			/* far enough for a point mass. the centre of mass is within
+			 * size*sqrt(2) of any body in the cell, so with theta <=
+			 * 1/sqrt(2) a cell never passes for a body inside it (which
+			 * would then attract itself) */
+			d2 += SOFTENING_KM2;
+			double s = nd->gm / (d2 * sqrt(d2));
+			ax += dx * s;
+			ay += dy * s;
+		} else {
+			for (int c = 0; c < 4; c++) stack[sp++] = nd->child + c;
+		}
+	}
+
+	nb->ax[i] = ax;
+	nb->ay[i] = ay;
+}
+
+static void accelerate_task(void* usr, int i0, int i1)
+{
+	struct nbody* nb = usr;
+	TRACE_BEGIN("nbody forces");
+	for (int i = i0; i < i1; i++) accelerate(nb, i);
+	TRACE_END("nbody forces");
+}
+
+static void update_accelerations(struct nbody* nb)
+{
+	ASSERT(nb->theta >= 0 && nb->theta * nb->theta <= 0.5); // see accelerate()
+	TRACE_BEGIN("nbody tree");
+	build_tree(nb);
+	TRACE_END("nbody tree");
+	pool_for(nb->n, TASK_BODIES, accelerate_task, nb);
+}
+
+static void step(struct nbody* nb, double dt)
+{
+	int n = nb->n;
+	double h = dt * 0.5;
+	for (int i = 0; i < n; i++) {
+		nb->vx[i] += nb->ax[i] * h;
+		nb->vy[i] += nb->ay[i] * h;
+		nb->x[i] += nb->vx[i] * dt;
+		nb->y[i] += nb->vy[i] * dt;
+	}
+	update_accelerations(nb);
+	for (int i = 0; i < n; i++) {
+		nb->vx[i] += nb->ax[i] * h;
+		nb->vy[i] += nb->ay[i] * h;
+	}
+}
+
+void nbody_init(struct nbody* nb, struct celestial_body* bodies, int n, int64_t t60)
+{
+	memset(nb, 0, sizeof(*nb));
+	nb->n = n;
+	nb->t60 = t60;
+	nb->theta = 0.5;
+	nb->max_steps = 256;
+	AN(nb->x = calloc(n, sizeof(double)));
+	AN(nb->y = calloc(n, sizeof(double)));
+	AN(nb->vx = calloc(n, sizeof(double)));
+	AN(nb->vy = calloc(n, sizeof(double)));
+	AN(nb->ax = calloc(n, sizeof(double)));
+	AN(nb->ay = calloc(n, sizeof(double)));
+	AN(nb->gm = calloc(n, sizeof(double)));
+	AN(nb->massive = calloc(n, sizeof(int)));
+
+	/* two-body state relative to the parent, in double; the array is
+	 * breadth-first, so parents are done first */
+	double t = (double)t60 / 60.0;
+	double min_period = 0;
+	double mx = 0, my = 0, mvx = 0, mvy = 0, total_gm = 0;
+	for (int i = 0; i < n; i++) {
+		struct celestial_body* body = &bodies[i];
+		nb->gm[i] = G * (double)body->mass_kg;
+		if (nb->gm[i] > 0) nb->massive[nb->n_massive++] = i;
+
+		int p = body->parent;
+		if (p >= 0) {
+			ASSERT(p < i);
+			double a = body->semi_major_axis_km;
+			double e = body->eccentricity;
+			double b = a * sqrt(1 - e*e);
+			double mm = body->mean_motion_rad_s;
+			double E = kepler_solve_double(body->M0_rad + mm * t, e);
+			double cE = cos(E);
+			double sE = sin(E);
+			double dE = mm / (1 - e * cE);
+			double Ex = (cE - e) * a;
+			double Ey = sE * b;
+			double Vx = -sE * a * dE;
+			double Vy = cE * b * dE;
+			double cl = cos(body->longitude_of_periapsis_rad);
+			double sl = sin(body->longitude_of_periapsis_rad);
+			nb->x[i] = nb->x[p] + cl * Ex - sl * Ey;
+			nb->y[i] = nb->y[p] + sl * Ex + cl * Ey;
+			nb->vx[i] = nb->vx[p] + cl * Vx - sl * Vy;
+			nb->vy[i] = nb->vy[p] + sl * Vx + cl * Vy;
+
+			if (mm > 0) {
+				double period = TAU / mm;
+				if (min_period == 0 || period < min_period) min_period = period;
+			}
+		}
+
+		mx += nb->gm[i] * nb->x[i];
+		my += nb->gm[i] * nb->y[i];
+		mvx += nb->gm[i] * nb->vx[i];
+		mvy += nb->gm[i] * nb->vy[i];
+		total_gm += nb->gm[i];
+	}
+
+	// to the barycentric frame, so the system as a whole stays put
+	if (total_gm > 0) {
+		mx /= total_gm;
+		my /= total_gm;
+		mvx /= total_gm;
+		mvy /= total_gm;
+		for (int i = 0; i < n; i++) {
+			nb->x[i] -= mx;
+			nb->y[i] -= my;
+			nb->vx[i] -= mvx;
+			nb->vy[i] -= mvy;
+		}
+	}
+
+	nb->step60 = min_period > 0 ? (int64_t)(min_period / NBODY_STEPS_PER_ORBIT * 60.0) : 60*60*60;
+	if (nb->step60 < 1) nb->step60 = 1;
+
+	update_accelerations(nb);
+}
+
+void nbody_free(struct nbody* nb)
+{
+	free(nb->x);
+	free(nb->y);
+	free(nb->vx);
+	free(nb->vy);
+	free(nb->ax);
+	free(nb->ay);
+	free(nb->gm);
+	free(nb->massive);
+	free(nb->nodes);
+	memset(nb, 0, sizeof(*nb));
+}
+
+int nbody_advance(struct nbody* nb, int64_t t60)
+{
+	int steps = 0;
+	double dt = (double)nb->step60 / 60.0;
+	while (steps < nb->max_steps) {
+		int64_t remaining = t60 - nb->t60;
+		if (remaining >= nb->step60) {
+			step(nb, dt);
+			nb->t60 += nb->step60;
+		} else if (-remaining >= nb->step60) {
+			step(nb, -dt);
+			nb->t60 -= nb->step60;
+		} else {
+			break;
+		}
+		steps++;
+	}
+	return steps;
+}
+
+void nbody_positions(struct nbody* nb, int64_t t60, float* x, float* y)
+{
+	double dt = (double)(t60 - nb->t60) / 60.0;
+	for (int i = 0; i < nb->n; i++) {
+		x[i] = nb->x[i] + nb->vx[i] * dt;
+		y[i] = nb->y[i] + nb->vy[i] * dt;
+	}
+}
+
+double nbody_energy(struct nbody* nb)
+{
+	double e = 0;
+	for (int k = 0; k < nb->n_massive; k++) {
+		int i = nb->massive[k];
+		e += 0.5 * nb->gm[i] * (nb->vx[i]*nb->vx[i] + nb->vy[i]*nb->vy[i]);
+		for (int l = k + 1; l < nb->n_massive; l++) {
+			int j = nb->massive[l];
+			double dx = nb->x[j] - nb->x[i];
+			double dy = nb->y[j] - nb->y[i];
+			e -= nb->gm[i] * nb->gm[j] / sqrt(dx*dx + dy*dy + SOFTENING_KM2);
+		}
+	}
+	return e;
+}
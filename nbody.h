@@ -0,0 +1,68 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#include <stdint.h>
+
+#include "sol.h"
+
+/* N-body mode: state vectors integrated with fixed-step kick-drift-kick
+ * leapfrog (symplectic and time-reversible, so negative steps are fine).
+ * initial conditions come from the two-body elements of a body array.
+ * accelerations come from a Barnes-Hut quadtree over the bodies with mass;
+ * massless bodies (e.g. most minor bodies) are test particles that feel
+ * the tree but are not in it */
+
+// default step is the shortest orbital period divided by this
+#define NBODY_STEPS_PER_ORBIT (128)
+
+struct nbody_node {
+	double cx, cy; // centre of mass
+	double gm;
+	double size; // side of the square cell
+	int child; // first of 4 consecutive children, or -1 for a leaf
+	int i0, i1; // leaf bodies are massive[i0;i1)
+};
+
+struct nbody {
+	int n;
+	// barycentric, km and km/s
+	double* x;
+	double* y;
+	double* vx;
+	double* vy;
+	double* ax; // at t60
+	double* ay;
+	double* gm; // G*mass_kg, km3/s2
+
+	int64_t t60; // time of the state above
+	int64_t step60;
+	int max_steps; // per nbody_advance(); the state lags behind when exceeded
+
+	// opening angle: a cell is used as a point mass when size/distance <
+	// theta. 0 gives the direct sum; at most 1/sqrt(2)
+	double theta;
+
+	int n_massive;
+	int* massive; // body ids, permuted by the tree build
+
+	int n_nodes;
+	int max_nodes;
+	struct nbody_node* nodes;
+};
+
+// seeds the state from the elements of bodies (as for kepler_batch) at t60
+void nbody_init(struct nbody* nb, struct celestial_body* bodies, int n, int64_t t60);
+void nbody_free(struct nbody* nb);
+
+// steps towards t60 (either direction) until less than a step remains, or
+// max_steps were taken; returns the number of steps
+int nbody_advance(struct nbody* nb, int64_t t60);
+
+// positions extrapolated from nb->t60 to t60 along the velocities
+void nbody_positions(struct nbody* nb, int64_t t60, float* x, float* y);
+
+// kinetic plus potential energy of the massive bodies, times G (direct sum;
+// for diagnostics)
+double nbody_energy(struct nbody* nb);
+
+#endif/*NBODY_H*/
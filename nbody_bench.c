@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "a.h"
+#include "m.h"
+#include "sol.h"
+#include "pool.h"
+#include "nbody.h"
+
+/* nbody_bench: the sol.c bodies plus n synthetic asteroids (default 5000)
+ * with mass, so they are all in the tree, on n_threads threads (default 1).
+ * reports time per step with the tree and with the direct sum (theta=0),
+ * the tree's relative force error against the direct sum, and the energy
+ * drift over a simulated year */
+
+#define STEPS (20)
+
+static double time_steps(struct nbody* nb, double theta)
+{
+	nb->theta = theta;
+	double t0 = now();
+	for (int s = 0; s < STEPS; s++) nbody_advance(nb, nb->t60 + nb->step60);
+	return (now() - t0) / STEPS;
+}
+
+int main(int argc, char** argv)
+{
+	int n_minor = argc > 1 ? atoi(argv[1]) : 5000;
+	int n_threads = argc > 2 ? atoi(argv[2]) : 1;
+	pool_init(n_threads);
+
+	int n_bodies = 0;
+	struct celestial_body* planets = mksol(&n_bodies);
+	int first;
+	struct celestial_body* bodies = sol_insert_satellites(planets, &n_bodies, 0, n_minor, CBC_MINOR, &first);
+	free(planets);
+	srand(1);
+	for (int i = first; i < first + n_minor; i++) {
+		bodies[i].mass_kg = randf(1e15, 1e20);
+		celestial_body_set_elements(bodies, i, randf(1.8, 5.5) * AU_IN_KM, randf(0, 0.3), randf(0, TAU), randf(0, TAU));
+	}
+
+	struct nbody nb;
+	nbody_init(&nb, bodies, n_bodies, 0);
+	printf("%d bodies (%d massive), %d threads, step %.1f s\n", n_bodies, nb.n_massive, pool_n_threads(), nb.step60 / 60.0);
+
+	// force error; accelerations are those at nb.t60 after each advance
+	nb.theta = 0;
+	nbody_advance(&nb, nb.t60 + nb.step60);
+	double* ax = malloc(n_bodies * sizeof(double));
+	double* ay = malloc(n_bodies * sizeof(double));
+	AN(ax); AN(ay);
+	for (int i = 0; i < n_bodies; i++) {
+		ax[i] = nb.ax[i];
+		ay[i] = nb.ay[i];
+	}
+	nbody_advance(&nb, nb.t60 - nb.step60);
+	nb.theta = 0.5;
+	nbody_advance(&nb, nb.t60 + nb.step60);
+	double max_err = 0, sum_err = 0;
+	for (int i = 0; i < n_bodies; i++) {
+		double dx = nb.ax[i] - ax[i];
+		double dy = nb.ay[i] - ay[i];
+		double err = sqrt((dx*dx + dy*dy) / (ax[i]*ax[i] + ay[i]*ay[i]));
+		if (err > max_err) max_err = err;
+		sum_err += err;
+	}
+	printf("tree force error (theta=0.5): mean %.2e, max %.2e\n", sum_err / n_bodies, max_err);
+
+	double t_tree = time_steps(&nb, 0.5);
+	double t_direct = time_steps(&nb, 0);
+	printf("step: tree %.3f ms, direct %.3f ms\n", t_tree * 1e3, t_direct * 1e3);
+
+	/* a year of the planets and moons alone, and back again; leapfrog is
+	 * time-reversible, so the round trip only suffers from rounding */
+	int n_sol = 0;
+	struct celestial_body* sol = mksol(&n_sol);
+	struct nbody sb;
+	nbody_init(&sb, sol, n_sol, 0);
+	sb.max_steps = 1 << 30;
+	double x0 = sb.x[n_sol - 1];
+	double y0 = sb.y[n_sol - 1];
+	double e0 = nbody_energy(&sb);
+	int64_t year60 = (int64_t)365 * 24 * 60 * 60 * 60;
+	double t0 = now();
+	int steps = nbody_advance(&sb, year60);
+	double t1 = now();
+	double e1 = nbody_energy(&sb);
+	printf("sol, 1 year: %d steps in %.3f s, relative energy drift %.2e\n", steps, t1 - t0, fabs((e1 - e0) / e0));
+	nbody_advance(&sb, 0);
+	printf("and back: %s off by %.3f km\n", celestial_body_name(&sol[n_sol - 1]), hypot(sb.x[n_sol - 1] - x0, sb.y[n_sol - 1] - y0));
+
+	nbody_free(&sb);
+	nbody_free(&nb);
+	free(ax);
+	free(ay);
+	pool_shutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,215 @@
+#include <math.h>
+
+#include "m.h"
+#include "kepler.h"
+#include "orbit.h"
+
+#define ORBIT_ARC_MAX_DEPTH (24)
+
+// first vertex pair of a level
+static int lod_first_pair(int lod)
+{
+	return ORBIT_LOD0_SEGMENTS * ((1<<lod) - 1) + lod;
+}
+
+static void emit_pair(float* v, float x, float y, float nx, float ny, float u, const float* color, int slot)
+{
+	for (int side = 0; side < 2; side++, v += ORBIT_FLOATS_PER_VERTEX) {
+		v[0] = x;
+		v[1] = y;
+		v[2] = nx;
+		v[3] = ny;
+		v[4] = u;
+		v[5] = side ? 1 : -1;
+		v[6] = color[0];
+		v[7] = color[1];
+		v[8] = color[2];
+		v[9] = color[3];
+		v[10] = slot;
+	}
+}
+
+void orbit_build(struct celestial_body* body, const float* color, int slot, float* vertices)
+{
+	float a = body->semi_major_axis_km;
+	float e = body->eccentricity;
+	float b = body->semi_minor_axis_km;
+	for (int lod = 0; lod < ORBIT_LODS; lod++) {
+		int N = orbit_lod_segments(lod);
+		float* lv = &vertices[lod_first_pair(lod) * 2 * ORBIT_FLOATS_PER_VERTEX];
+		for (int i = 0; i <= N; i++) {
+			float E = (float)(i%N)/(float)N*TAU;
+			float x,y,nx,ny;
+			calc_ellipse_position(E, e, a, b, body->cos_lop, body->sin_lop, &x, &y, &nx, &ny);
+
+			float dn = 1.0/sqrtf(nx*nx + ny*ny);
+			float Mx = (mean_anomaly_from_eccentric_anomaly((float)i/(float)N*TAU, e) / TAU) * 12.0;
+			emit_pair(&lv[i * 2 * ORBIT_FLOATS_PER_VERTEX], x, y, nx*dn, ny*dn, Mx, color, slot);
+		}
+	}
+}
+
+static void quads(uint32_t base, int n, uint32_t* indices)
+{
+	for (int i = 0; i < n; i++) {
+		uint32_t i1 = base + (i<<1);
+		uint32_t i2 = base + ((i+1)<<1);
+		uint32_t* q = &indices[i*4];
+		q[0] = i1;
+		q[1] = i1+1;
+		q[2] = i2+1;
+		q[3] = i2;
+	}
+}
+
+void orbit_build_indices(uint32_t base, uint32_t* indices)
+{
+	for (int lod = 0; lod < ORBIT_LODS; lod++) {
+		quads(base + lod_first_pair(lod) * 2, orbit_lod_segments(lod), &indices[orbit_lod_first_index(lod)]);
+	}
+}
+
+int orbit_lod(float radius_px)
+{
+	/* chords of N segments are at most a*(1-cos(pi/N)) ~= a*(pi/N)^2/2
+	 * from the ellipse (the worst case is at the ends of the major axis,
+	 * where E-uniform chords meet the tightest curvature) */
+	float min_segments = (float)(TAU/2) * sqrtf(radius_px / (2 * ORBIT_TOLERANCE_PX));
+	for (int lod = 0; lod < ORBIT_LODS; lod++) {
+		if ((float)orbit_lod_segments(lod) >= min_segments) return lod;
+	}
+	return ORBIT_LODS;
+}
+
+
+struct clip {
+	double a, b, e;
+	double cos_lop, sin_lop;
+	double parent_x, parent_y;
+	double scale;
+	double hw, hh; // visible half extents, including the line width
+
+	const float* color;
+	int slot;
+	float* vertices;
+	struct orbit_arcs* arcs;
+	int open; // last emitted pair ends the current run
+	int full;
+};
+
+static void clip_point(struct clip* c, double E, double* x, double* y)
+{
+	double Ex = (cos(E) - c->e) * c->a;
+	double Ey = sin(E) * c->b;
+	*x = c->parent_x + (c->cos_lop * Ex - c->sin_lop * Ey) * c->scale;
+	*y = c->parent_y + (c->sin_lop * Ex + c->cos_lop * Ey) * c->scale;
+}
+
+static void clip_emit(struct clip* c, double E, double x, double y)
+{
+	double cE = cos(E);
+	double sE = sin(E);
+	double Nx = cE * c->b;
+	double Ny = sE * c->a;
+	double nx = c->cos_lop * Nx - c->sin_lop * Ny;
+	double ny = c->sin_lop * Nx + c->cos_lop * Ny;
+	double dn = 1.0 / sqrt(nx*nx + ny*ny);
+	double Mx = (E - c->e * sE) / TAU * 12.0;
+	emit_pair(&c->vertices[c->arcs->n_vertices * ORBIT_FLOATS_PER_VERTEX], x, y, nx*dn, ny*dn, Mx, c->color, c->slot);
+	c->arcs->n_vertices += 2;
+}
+
+static void clip_segment(struct clip* c, double E0, double x0, double y0, double E1, double x1, double y1)
+{
+	struct orbit_arcs* arcs = c->arcs;
+	if (arcs->n_vertices + (c->open ? 2 : 4) > ORBIT_ARC_MAX_VERTICES || (!c->open && arcs->n_runs == ORBIT_ARC_MAX_RUNS)) {
+		c->full = 1;
+		return;
+	}
+	if (!c->open) {
+		arcs->run_first[arcs->n_runs] = arcs->n_vertices / 2;
+		arcs->run_segments[arcs->n_runs] = 0;
+		arcs->n_runs++;
+		clip_emit(c, E0, x0, y0);
+		c->open = 1;
+	}
+	clip_emit(c, E1, x1, y1);
+	arcs->run_segments[arcs->n_runs-1]++;
+}
+
+static void clip_refine(struct clip* c, double E0, double x0, double y0, double E1, double x1, double y1, int depth)
+{
+	if (c->full) return;
+
+	double Em = (E0 + E1) * 0.5;
+	double xm, ym;
+	clip_point(c, Em, &xm, &ym);
+	double dx = xm - (x0 + x1) * 0.5;
+	double dy = ym - (y0 + y1) * 0.5;
+	double d = sqrt(dx*dx + dy*dy);
+
+	// the arc stays within its chord's bounding box grown by ~d
+	double r = 2*d;
+	double minx = fmin(fmin(x0, x1), xm) - r;
+	double maxx = fmax(fmax(x0, x1), xm) + r;
+	double miny = fmin(fmin(y0, y1), ym) - r;
+	double maxy = fmax(fmax(y0, y1), ym) + r;
+	if (maxx < -c->hw || minx > c->hw || maxy < -c->hh || miny > c->hh) {
+		c->open = 0;
+		return;
+	}
+
+	if (d <= ORBIT_TOLERANCE_PX || depth >= ORBIT_ARC_MAX_DEPTH) {
+		clip_segment(c, E0, x0, y0, E1, x1, y1);
+		return;
+	}
+	clip_refine(c, E0, x0, y0, Em, xm, ym, depth+1);
+	clip_refine(c, Em, xm, ym, E1, x1, y1, depth+1);
+}
+
+void orbit_clip(
+	struct celestial_body* body,
+	const float* color,
+	int slot,
+	float parent_x,
+	float parent_y,
+	float scale,
+	int window_width,
+	int window_height,
+	float* vertices,
+	struct orbit_arcs* arcs)
+{
+	struct clip c;
+	c.a = body->semi_major_axis_km;
+	c.b = body->semi_minor_axis_km;
+	c.e = body->eccentricity;
+	c.cos_lop = body->cos_lop;
+	c.sin_lop = body->sin_lop;
+	c.parent_x = parent_x;
+	c.parent_y = parent_y;
+	c.scale = scale;
+	c.hw = window_width * 0.5 + ORBIT_WIDTH + 1;
+	c.hh = window_height * 0.5 + ORBIT_WIDTH + 1;
+	c.color = color;
+	c.slot = slot;
+	c.vertices = vertices;
+	c.arcs = arcs;
+	c.open = 0;
+	c.full = 0;
+
+	// the whole orbit is within a*(1+e) of the parent
+	double r = c.a * (1 + c.e) * scale;
+	if (parent_x + r < -c.hw || parent_x - r > c.hw || parent_y + r < -c.hh || parent_y - r > c.hh) return;
+
+	double E0 = 0, x0, y0;
+	clip_point(&c, E0, &x0, &y0);
+	for (int i = 1; i <= ORBIT_ARC_COARSE && !c.full; i++) {
+		double E1 = (double)i / ORBIT_ARC_COARSE * TAU;
+		double x1, y1;
+		clip_point(&c, E1, &x1, &y1);
+		clip_refine(&c, E0, x0, y0, E1, x1, y1, 0);
+		E0 = E1;
+		x0 = x1;
+		y0 = y1;
+	}
+}
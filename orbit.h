@@ -0,0 +1,76 @@
+#ifndef ORBIT_H
+#define ORBIT_H
+
+#include <stdint.h>
+
+#include "sol.h"
+
+/* orbit geometry: a body's ellipse as a strip of quads, widened along its
+ * normals by ORBIT_WIDTH pixels in the vertex shader.
+ *
+ * orbits that fit on screen use static geometry in orbit-local coordinates
+ * (km from the parent), built once per body at ORBIT_LODS levels of detail;
+ * orbit_lod() picks the coarsest level whose chords stay within
+ * ORBIT_TOLERANCE_PX of the curve at the projected size.
+ *
+ * orbits that don't fit (zoomed in) are clipped instead: orbit_clip()
+ * builds only the on-screen arcs, in pixels from the window centre,
+ * bisecting them until they are within the same tolerance.
+ *
+ * vertices carry their colour and a slot, which the path shader uses to
+ * look up per-orbit placement, so that all orbits draw in one batch */
+
+#define ORBIT_WIDTH (6) // pixels each side of the ellipse
+#define ORBIT_TOLERANCE_PX (0.25f)
+
+// x, y, nx, ny (unit normal), u (mean anomaly in 1/12 revolutions), v (-1
+// inside, 1 outside), r, g, b, a, slot
+#define ORBIT_FLOATS_PER_VERTEX (11)
+
+// static levels of detail, of ORBIT_LOD0_SEGMENTS<<lod segments each
+#define ORBIT_LOD0_SEGMENTS (16)
+#define ORBIT_LODS (6)
+#define ORBIT_SEGMENTS (ORBIT_LOD0_SEGMENTS * ((1<<ORBIT_LODS) - 1)) // all levels
+#define ORBIT_VERTICES ((ORBIT_SEGMENTS + ORBIT_LODS) * 2)
+#define ORBIT_VERTEX_FLOATS (ORBIT_VERTICES * ORBIT_FLOATS_PER_VERTEX)
+#define ORBIT_INDICES (ORBIT_SEGMENTS * 4)
+
+void orbit_build(struct celestial_body* body, const float* color, int slot, float* vertices); // ORBIT_VERTEX_FLOATS
+// quads for an orbit whose vertices start at base
+void orbit_build_indices(uint32_t base, uint32_t* indices); // ORBIT_INDICES
+
+// level for a semi-major axis of radius_px pixels; ORBIT_LODS if none is
+// fine enough
+int orbit_lod(float radius_px);
+static inline int orbit_lod_segments(int lod) { return ORBIT_LOD0_SEGMENTS << lod; }
+// offset of a level within the orbit's indices
+static inline int orbit_lod_first_index(int lod) { return ORBIT_LOD0_SEGMENTS * ((1<<lod) - 1) * 4; }
+
+#define ORBIT_ARC_COARSE (64) // segments tested for visibility, then bisected
+#define ORBIT_ARC_MAX_VERTICES (16384)
+#define ORBIT_ARC_MAX_RUNS (256)
+
+struct orbit_arcs {
+	int n_vertices;
+	int n_runs;
+	// a run of n segments starting at vertex pair first
+	int run_first[ORBIT_ARC_MAX_RUNS];
+	int run_segments[ORBIT_ARC_MAX_RUNS];
+};
+
+// appends the on-screen arcs of the orbit around a parent at
+// (parent_x,parent_y) pixels from the window centre, at scale pixels per km;
+// clear n_vertices and n_runs to start over
+void orbit_clip(
+	struct celestial_body* body,
+	const float* color,
+	int slot,
+	float parent_x,
+	float parent_y,
+	float scale,
+	int window_width,
+	int window_height,
+	float* vertices, // ORBIT_ARC_MAX_VERTICES * ORBIT_FLOATS_PER_VERTEX
+	struct orbit_arcs* arcs);
+
+#endif/*ORBIT_H*/
@@ -1,15 +1,29 @@
+@define AA 0 1 3
 @vert
 #version 130
 
-attribute vec2 a_position;
+attribute vec2 a_position; // km from the parent, or pixels for clipped arcs
+attribute vec2 a_normal;
 attribute vec2 a_uv;
+attribute vec4 a_color;
+attribute float a_slot;
+
+// per slot: parent offset in pixels (xy), pixels per a_position unit (z);
+// ORBIT_TEXTURE_WIDTH slots per row
+uniform sampler2D u_orbits;
+uniform vec2 u_ndc; // pixels to NDC
+uniform vec2 u_width; // ORBIT_WIDTH, in NDC
 
 varying vec2 v_uv;
+varying vec4 v_color;
 
 void main()
 {
+	int slot = int(a_slot);
+	vec4 orbit = texelFetch(u_orbits, ivec2(slot % 256, slot / 256), 0);
 	v_uv = a_uv;
-	gl_Position = vec4(a_position, 0, 1);
+	v_color = a_color;
+	gl_Position = vec4((orbit.xy + a_position * orbit.z) * u_ndc + a_normal * (a_uv.y * u_width), 0, 1);
 }
 
 
@@ -17,13 +31,28 @@ void main()
 #version 130
 
 varying vec2 v_uv;
+varying vec4 v_color;
 
 uniform vec2 u_mu;
-uniform vec4 u_color1;
+
+/* AA is the supersampling radius, for (2AA+1)^2 samples per fragment, or
+ * 0 for one sample with its edges ramped over the 7x7 footprint. all tiers
+ * keep the original 7x7 normalisation, sum/36, i.e. a GAIN of 49/36 */
+const float GAIN = 49.0/36.0;
+const float FOOTPRINT = 7.0; // in units of mu
 
 void main(void)
 {
-	const float N = 3;
+#if AA == 0
+	float fx = 1 - fract(v_uv.x);
+	float fx3 = fx*fx*fx;
+	float thr = 0.25 + fx3 * 0.1;
+	float coverage = clamp((thr - abs(v_uv.y)) / (FOOTPRINT * u_mu.y) + 0.5, 0, 1);
+	vec4 color = v_color * (0.6 + fx3 * 0.4);
+	if (v_uv.x < 0.5) color += vec4(1,1,1,1) * (0.5-v_uv.x);
+	gl_FragColor = color * (coverage * GAIN);
+#else
+	const float N = AA;
 	vec4 color = vec4(0,0,0,0);
 	for (float dy = -N; dy <= N; dy++) {
 		for (float dx = -N; dx <= N; dx++) {
@@ -32,14 +61,11 @@ void main(void)
 			float fx3 = fx*fx*fx;
 			float thr = 0.25 + fx3 * 0.1;
 			if (uv.y >= -thr && uv.y <= thr) {
-				color += u_color1 * (0.6 + fx3 * 0.4);
+				color += v_color * (0.6 + fx3 * 0.4);
 				if (uv.x < 0.5) color += vec4(1,1,1,1) * (0.5-uv.x);
 			}
 		}
 	}
-	gl_FragColor = color / float(N*N*4);
+	gl_FragColor = color * (GAIN / ((2*N+1)*(2*N+1)));
+#endif
 }
-
-
-
-
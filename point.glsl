@@ -0,0 +1,21 @@
+@vert
+#version 130
+
+attribute vec2 a_position;
+
+void main()
+{
+	gl_Position = vec4(a_position, 0, 1);
+}
+
+
+@frag
+#version 130
+
+uniform vec4 u_color;
+
+void main(void)
+{
+	gl_FragColor = u_color;
+}
+
@@ -0,0 +1,205 @@
+#define _XOPEN_SOURCE 700
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "a.h"
+#include "pool.h"
+#include "trace.h"
+
+#define MAX_THREADS (256)
+
+struct task {
+	int i0, i1;
+};
+
+struct deque {
+	pthread_mutex_t lock;
+	struct task* tasks;
+	int cap;
+	int top; // stolen from here
+	int bottom; // pushed and popped here by the owner
+};
+
+static struct {
+	int n_threads; // 0 before pool_init()
+	pthread_t threads[MAX_THREADS];
+	char names[MAX_THREADS][16]; // for trace_set_thread_name()
+	struct deque deques[MAX_THREADS]; // deques[0] belongs to the caller of pool_for()
+
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_cond_t done;
+	int epoch; // bumped by each pool_for()
+	int quit;
+	int busy;
+
+	int pending; // tasks not yet finished
+	pool_fn fn;
+	void* usr;
+} pool;
+
+static int pop(int self, struct task* task)
+{
+	struct deque* d = &pool.deques[self];
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top) {
+		*task = d->tasks[--d->bottom];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static int steal(int victim, struct task* task)
+{
+	struct deque* d = &pool.deques[victim];
+	int found = 0;
+	pthread_mutex_lock(&d->lock);
+	if (d->bottom > d->top) {
+		*task = d->tasks[d->top++];
+		found = 1;
+	}
+	pthread_mutex_unlock(&d->lock);
+	return found;
+}
+
+static void run_tasks(int self)
+{
+	for (;;) {
+		struct task task;
+		int found = pop(self, &task);
+		for (int k = 1; !found && k < pool.n_threads; k++) {
+			found = steal((self + k) % pool.n_threads, &task);
+		}
+		if (!found) return;
+
+		pool.fn(pool.usr, task.i0, task.i1);
+
+		if (__atomic_sub_fetch(&pool.pending, 1, __ATOMIC_ACQ_REL) == 0) {
+			pthread_mutex_lock(&pool.lock);
+			pthread_cond_broadcast(&pool.done);
+			pthread_mutex_unlock(&pool.lock);
+		}
+	}
+}
+
+static void* worker(void* arg)
+{
+	int self = (intptr_t)arg;
+	int seen = 0;
+	trace_set_thread_name(pool.names[self]);
+	for (;;) {
+		pthread_mutex_lock(&pool.lock);
+		while (pool.epoch == seen && !pool.quit) pthread_cond_wait(&pool.wake, &pool.lock);
+		int quit = pool.quit;
+		seen = pool.epoch;
+		pthread_mutex_unlock(&pool.lock);
+		if (quit) return NULL;
+		run_tasks(self);
+	}
+}
+
+void pool_init(int n_threads)
+{
+	AZ(pool.n_threads);
+	if (n_threads < 1) n_threads = 1;
+	if (n_threads > MAX_THREADS) n_threads = MAX_THREADS;
+
+	memset(&pool, 0, sizeof(pool));
+	pool.n_threads = n_threads;
+	AZ(pthread_mutex_init(&pool.lock, NULL));
+	AZ(pthread_cond_init(&pool.wake, NULL));
+	AZ(pthread_cond_init(&pool.done, NULL));
+	for (int i = 0; i < n_threads; i++) {
+		AZ(pthread_mutex_init(&pool.deques[i].lock, NULL));
+	}
+	for (int i = 1; i < n_threads; i++) {
+		snprintf(pool.names[i], sizeof(pool.names[i]), "pool %d", i);
+		AZ(pthread_create(&pool.threads[i], NULL, worker, (void*)(intptr_t)i));
+	}
+}
+
+void pool_shutdown()
+{
+	if (pool.n_threads == 0) return;
+
+	pthread_mutex_lock(&pool.lock);
+	pool.quit = 1;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+	for (int i = 1; i < pool.n_threads; i++) AZ(pthread_join(pool.threads[i], NULL));
+
+	for (int i = 0; i < pool.n_threads; i++) {
+		pthread_mutex_destroy(&pool.deques[i].lock);
+		free(pool.deques[i].tasks);
+	}
+	pthread_cond_destroy(&pool.done);
+	pthread_cond_destroy(&pool.wake);
+	pthread_mutex_destroy(&pool.lock);
+	memset(&pool, 0, sizeof(pool));
+}
+
+int pool_n_threads()
+{
+	return pool.n_threads > 0 ? pool.n_threads : 1;
+}
+
+void pool_for(int n, int chunk, pool_fn fn, void* usr)
+{
+	if (n <= 0) return;
+	ASSERT(chunk > 0);
+	int n_tasks = (n + chunk - 1) / chunk;
+
+	if (pool.n_threads <= 1 || n_tasks == 1) {
+		for (int i0 = 0; i0 < n; i0 += chunk) fn(usr, i0, i0 + chunk < n ? i0 + chunk : n);
+		return;
+	}
+
+	AZ(pool.busy);
+	pool.busy = 1;
+	pool.fn = fn;
+	pool.usr = usr;
+	__atomic_store_n(&pool.pending, n_tasks, __ATOMIC_RELEASE);
+
+	/* contiguous runs of tasks per thread, so each starts out on its own
+	 * part of the range; the tasks are pushed in reverse so the owner pops
+	 * them in order */
+	int T = pool.n_threads;
+	for (int k = 0; k < T; k++) {
+		int t0 = (int)((int64_t)n_tasks * k / T);
+		int t1 = (int)((int64_t)n_tasks * (k+1) / T);
+		struct deque* d = &pool.deques[k];
+		pthread_mutex_lock(&d->lock);
+		ASSERT(d->bottom == d->top);
+		if (d->cap < t1 - t0) {
+			d->cap = t1 - t0;
+			AN(d->tasks = realloc(d->tasks, d->cap * sizeof(struct task)));
+		}
+		d->top = 0;
+		d->bottom = 0;
+		for (int t = t1 - 1; t >= t0; t--) {
+			struct task* task = &d->tasks[d->bottom++];
+			task->i0 = t * chunk;
+			task->i1 = (t+1) * chunk < n ? (t+1) * chunk : n;
+		}
+		pthread_mutex_unlock(&d->lock);
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	pool.epoch++;
+	pthread_cond_broadcast(&pool.wake);
+	pthread_mutex_unlock(&pool.lock);
+
+	run_tasks(0);
+
+	pthread_mutex_lock(&pool.lock);
+	while (__atomic_load_n(&pool.pending, __ATOMIC_ACQUIRE) > 0) pthread_cond_wait(&pool.done, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+
+	pool.busy = 0;
+}
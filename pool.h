@@ -0,0 +1,21 @@
+#ifndef POOL_H
+#define POOL_H
+
+/* persistent worker pool. each thread (including the one calling
+ * pool_for()) has a deque of tasks; it pops from the bottom of its own, and
+ * steals from the top of the others' when it runs dry. without pool_init(),
+ * or with one thread, pool_for() just calls fn */
+
+typedef void (*pool_fn)(void* usr, int i0, int i1);
+
+// n_threads includes the calling thread
+void pool_init(int n_threads);
+void pool_shutdown();
+int pool_n_threads();
+
+/* runs fn(usr, i0, i1) over [0;n) in chunks of at most chunk items, and
+ * returns when all are done. only one pool_for() may run at a time, and fn
+ * must not call it */
+void pool_for(int n, int chunk, pool_fn fn, void* usr);
+
+#endif/*POOL_H*/
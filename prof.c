@@ -0,0 +1,160 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <GL/glew.h>
+
+#include "a.h"
+#include "prof.h"
+
+const char* prof_phase_names[PROF_N] = {
+	"events",
+	"positions",
+	"screen",
+	"pick",
+	"render",
+	"text",
+	"swap",
+};
+
+const char* prof_gpu_pass_names[PROF_GPU_N] = {
+	"gpu points",
+	"gpu orbits",
+	"gpu bodies",
+	"gpu text",
+};
+
+#ifndef NO_PROF
+
+int prof_enabled;
+
+static struct {
+	int frame; // frames recorded since prof_toggle()
+	double frame_start;
+
+	double start[PROF_N];
+	double current[PROF_N]; // accumulated this frame
+	float history[PROF_N][PROF_HISTORY]; // seconds
+	float frame_history[PROF_HISTORY];
+
+	int gpu;
+	int parity;
+	GLuint queries[2][PROF_GPU_N];
+	int pending[2][PROF_GPU_N];
+	int n_gpu[PROF_GPU_N];
+	float gpu_history[PROF_GPU_N][PROF_HISTORY];
+} prof;
+
+void prof_init()
+{
+	memset(&prof, 0, sizeof(prof));
+	prof.gpu = GLEW_ARB_timer_query;
+	if (prof.gpu) {
+		glGenQueries(2 * PROF_GPU_N, &prof.queries[0][0]); CHKGL;
+	}
+}
+
+void prof_toggle()
+{
+	prof_enabled = !prof_enabled;
+	prof.frame = 0;
+	prof.frame_start = now();
+	for (int p = 0; p < PROF_N; p++) prof.start[p] = prof.frame_start;
+	memset(prof.current, 0, sizeof(prof.current));
+	memset(prof.n_gpu, 0, sizeof(prof.n_gpu));
+}
+
+void prof_begin(enum prof_phase phase)
+{
+	prof.start[phase] = now();
+}
+
+void prof_end(enum prof_phase phase)
+{
+	prof.current[phase] += now() - prof.start[phase];
+}
+
+void prof_gpu_begin(enum prof_gpu_pass pass)
+{
+	// skip this frame if last use of the query hasn't come back yet
+	if (!prof.gpu || prof.pending[prof.parity][pass]) return;
+	glBeginQuery(GL_TIME_ELAPSED, prof.queries[prof.parity][pass]); CHKGL;
+}
+
+void prof_gpu_end(enum prof_gpu_pass pass)
+{
+	if (!prof.gpu || prof.pending[prof.parity][pass]) return;
+	glEndQuery(GL_TIME_ELAPSED); CHKGL;
+	prof.pending[prof.parity][pass] = 1;
+}
+
+void prof_frame()
+{
+	int h = prof.frame % PROF_HISTORY;
+	for (int p = 0; p < PROF_N; p++) {
+		prof.history[p][h] = prof.current[p];
+		prof.current[p] = 0;
+	}
+	double t = now();
+	prof.frame_history[h] = t - prof.frame_start;
+	prof.frame_start = t;
+	prof.frame++;
+
+	if (!prof.gpu) return;
+	prof.parity ^= 1;
+	for (int set = 0; set < 2; set++) {
+		for (int pass = 0; pass < PROF_GPU_N; pass++) {
+			if (!prof.pending[set][pass]) continue;
+			GLuint q = prof.queries[set][pass];
+			GLint available = 0;
+			glGetQueryObjectiv(q, GL_QUERY_RESULT_AVAILABLE, &available); CHKGL;
+			if (!available) continue;
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(q, GL_QUERY_RESULT, &ns); CHKGL;
+			prof.pending[set][pass] = 0;
+			prof.gpu_history[pass][prof.n_gpu[pass]++ % PROF_HISTORY] = (float)ns * 1e-9f;
+		}
+	}
+}
+
+static int cmp_float(const void* a, const void* b)
+{
+	float x = *(const float*)a;
+	float y = *(const float*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void draw_row(struct text* text, const char* name, const float* history, int n)
+{
+	if (n > PROF_HISTORY) n = PROF_HISTORY;
+	if (n == 0) {
+		text_printf(text, "%-11s          -\n", name);
+		return;
+	}
+	float sorted[PROF_HISTORY];
+	memcpy(sorted, history, n * sizeof(float));
+	qsort(sorted, n, sizeof(float), cmp_float);
+	double sum = 0;
+	for (int i = 0; i < n; i++) sum += sorted[i];
+	text_printf(text, "%-11s %7.3f %7.3f %7.3f\n",
+		name,
+		sum / n * 1e3,
+		sorted[n/2] * 1e3,
+		sorted[(n * 99) / 100] * 1e3);
+}
+
+void prof_draw(struct text* text, int x, int y)
+{
+	text_set_color3f(text, 1, 1, 0.7);
+	text_set_cursor(text, x, y);
+	text_printf(text, "%-11s %7s %7s %7s\n", "ms", "avg", "p50", "p99");
+	draw_row(text, "frame", prof.frame_history, prof.frame);
+	for (int p = 0; p < PROF_N; p++) draw_row(text, prof_phase_names[p], prof.history[p], prof.frame);
+	if (!prof.gpu) {
+		text_printf(text, "no GL_ARB_timer_query\n");
+		return;
+	}
+	for (int p = 0; p < PROF_GPU_N; p++) draw_row(text, prof_gpu_pass_names[p], prof.gpu_history[p], prof.n_gpu[p]);
+}
+
+#endif
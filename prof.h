@@ -0,0 +1,74 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include "text.h"
+#include "trace.h"
+
+/* frame profiler: CPU time per main loop phase, and GPU time per render
+ * pass from GL_TIME_ELAPSED queries (double-buffered and only read back
+ * once available, so they never stall). toggled at runtime with
+ * prof_toggle(); while off, each PROF_* is one test of prof_enabled. build
+ * with -DNO_PROF to compile it all out. phases and passes are also traced
+ * (see trace.h), which NO_PROF leaves alone */
+
+enum prof_phase {
+	PROF_EVENTS,
+	PROF_POSITIONS,
+	PROF_SCREEN,
+	PROF_PICK,
+	PROF_RENDER,
+	PROF_TEXT,
+	PROF_SWAP,
+	PROF_N
+};
+
+enum prof_gpu_pass {
+	PROF_GPU_POINTS,
+	PROF_GPU_ORBITS,
+	PROF_GPU_BODIES,
+	PROF_GPU_TEXT,
+	PROF_GPU_N
+};
+
+extern const char* prof_phase_names[PROF_N];
+extern const char* prof_gpu_pass_names[PROF_GPU_N];
+
+#ifndef NO_PROF
+
+extern int prof_enabled;
+
+void prof_init(); // needs a GL context
+void prof_toggle();
+void prof_begin(enum prof_phase phase);
+void prof_end(enum prof_phase phase);
+void prof_gpu_begin(enum prof_gpu_pass pass);
+void prof_gpu_end(enum prof_gpu_pass pass);
+void prof_frame(); // call once per frame
+// averages and percentiles over the last PROF_HISTORY frames, at (x,y)
+void prof_draw(struct text* text, int x, int y);
+
+#define PROF_HISTORY (128)
+
+#define PROF_INIT() prof_init()
+#define PROF_TOGGLE() prof_toggle()
+#define PROF_BEGIN(phase) do { if (prof_enabled) prof_begin(phase); TRACE_BEGIN(prof_phase_names[phase]); } while (0)
+#define PROF_END(phase) do { TRACE_END(prof_phase_names[phase]); if (prof_enabled) prof_end(phase); } while (0)
+#define PROF_GPU_BEGIN(pass) do { if (prof_enabled) prof_gpu_begin(pass); TRACE_BEGIN(prof_gpu_pass_names[pass]); } while (0)
+#define PROF_GPU_END(pass) do { TRACE_END(prof_gpu_pass_names[pass]); if (prof_enabled) prof_gpu_end(pass); } while (0)
+#define PROF_FRAME() do { if (prof_enabled) prof_frame(); } while (0)
+#define PROF_DRAW(text, x, y) do { if (prof_enabled) prof_draw(text, x, y); } while (0)
+
+#else
+
+#define PROF_INIT() do {} while (0)
+#define PROF_TOGGLE() do {} while (0)
+#define PROF_BEGIN(phase) TRACE_BEGIN(prof_phase_names[phase])
+#define PROF_END(phase) TRACE_END(prof_phase_names[phase])
+#define PROF_GPU_BEGIN(pass) TRACE_BEGIN(prof_gpu_pass_names[pass])
+#define PROF_GPU_END(pass) TRACE_END(prof_gpu_pass_names[pass])
+#define PROF_FRAME() do {} while (0)
+#define PROF_DRAW(text, x, y) do {} while (0)
+
+#endif
+
+#endif/*PROF_H*/
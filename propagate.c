@@ -0,0 +1,255 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "a.h"
+#include "sol.h"
+#include "mpc.h"
+#include "catalog.h"
+#include "pool.h"
+#include "world.h"
+
+/* propagate: headless batch propagation. positions of all bodies at
+   t0, t0+step, ... up to t1 (seconds from J2000), written as
+
+   csv: one row per body and time, "t_s,body,name,x_km,y_km"
+
+   bin (host byte order):
+     struct propagate_header
+     per time: double t_s, float x_km[n_bodies], float y_km[n_bodies]
+*/
+
+struct propagate_header {
+	char magic[8]; // "YOPROP"
+	uint32_t version;
+	uint32_t n_bodies;
+	uint64_t n_times;
+	double t0_s;
+	double step_s;
+};
+
+#define PROPAGATE_VERSION (1)
+
+#define CSV_CHUNK (4096)
+
+static void usage(const char* prg)
+{
+	fprintf(stderr, "usage: %s [-b <body catalog>] [-c <MPCORB.DAT>] [-n] [-j <threads>] [-f csv|bin] [-o <out>] <t0> <t1> <step>\n", prg);
+	fprintf(stderr, "  times are in seconds from J2000; -n integrates N-body instead of using the elements\n");
+	exit(EXIT_FAILURE);
+}
+
+static int64_t parse_t60(const char* s, const char* prg)
+{
+	char* end;
+	double t = strtod(s, &end);
+	if (end == s || *end != 0) usage(prg);
+	return (int64_t)(t * 60.0);
+}
+
+static void write_or_die(FILE* f, const void* data, size_t n, const char* path)
+{
+	if (n > 0 && fwrite(data, n, 1, f) != 1) arghf("%s: write error", path);
+}
+
+// v with 3 decimals, like "%.3f" (but rounding halves away from zero) without
+// printf's overhead; returns the length
+static int fmt_fixed3(char* p, double v)
+{
+	char tmp[32];
+	int n = 0;
+	int neg = v < 0;
+	uint64_t u = (uint64_t)((neg ? -v : v) * 1000.0 + 0.5);
+	for (int d = 0; d < 3; d++, u /= 10) tmp[n++] = '0' + u % 10;
+	tmp[n++] = '.';
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u > 0);
+	int len = 0;
+	if (neg) p[len++] = '-';
+	while (n > 0) p[len++] = tmp[--n];
+	return len;
+}
+
+// rows are formatted in parallel into one buffer per chunk of bodies
+struct csv_job {
+	struct world* world;
+	// times are whole 1/60 s, so 3 decimals tell steps apart
+	char t_s[32];
+	int t_s_len;
+	char** buf;
+	size_t* len;
+	size_t* cap;
+};
+
+static void csv_task(void* usr, int i0, int i1)
+{
+	struct csv_job* job = usr;
+	int k = i0 / CSV_CHUNK;
+	const float* x = job->world->kepler.x;
+	const float* y = job->world->kepler.y;
+	size_t len = 0;
+	for (int i = i0; i < i1; i++) {
+		const char* name = celestial_body_name(&job->world->sol[i]);
+		size_t need = len + job->t_s_len + strlen(name) + 96;
+		if (need > job->cap[k]) {
+			job->cap[k] = need * 2;
+			AN(job->buf[k] = realloc(job->buf[k], job->cap[k]));
+		}
+		char* p = job->buf[k] + len;
+		memcpy(p, job->t_s, job->t_s_len);
+		p += job->t_s_len;
+		p += sprintf(p, ",%d,%s,", i, name);
+		p += fmt_fixed3(p, x[i]);
+		*p++ = ',';
+		p += fmt_fixed3(p, y[i]);
+		*p++ = '\n';
+		len = p - job->buf[k];
+	}
+	job->len[k] = len;
+}
+
+int main(int argc, char** argv)
+{
+	const char* catalog_path = NULL;
+	const char* mpc_path = NULL;
+	const char* out_path = NULL;
+	int binary = 0;
+	int nbody = 0;
+	int n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-' && argv[i][1] != 0 && (argv[i][1] < '0' || argv[i][1] > '9'); i++) {
+		if (strcmp(argv[i], "-b") == 0 && i+1 < argc) {
+			catalog_path = argv[++i];
+		} else if (strcmp(argv[i], "-c") == 0 && i+1 < argc) {
+			mpc_path = argv[++i];
+		} else if (strcmp(argv[i], "-n") == 0) {
+			nbody = 1;
+		} else if (strcmp(argv[i], "-j") == 0 && i+1 < argc) {
+			n_threads = atoi(argv[++i]);
+			if (n_threads < 1) usage(argv[0]);
+		} else if (strcmp(argv[i], "-f") == 0 && i+1 < argc) {
+			i++;
+			if (strcmp(argv[i], "csv") == 0) {
+				binary = 0;
+			} else if (strcmp(argv[i], "bin") == 0) {
+				binary = 1;
+			} else {
+				usage(argv[0]);
+			}
+		} else if (strcmp(argv[i], "-o") == 0 && i+1 < argc) {
+			out_path = argv[++i];
+		} else {
+			usage(argv[0]);
+		}
+	}
+	if (argc - i != 3) usage(argv[0]);
+	int64_t t0_60 = parse_t60(argv[i], argv[0]);
+	int64_t t1_60 = parse_t60(argv[i+1], argv[0]);
+	int64_t step60 = parse_t60(argv[i+2], argv[0]);
+	if (step60 <= 0) usage(argv[0]);
+	if (t1_60 < t0_60) step60 = -step60;
+	int64_t n_times = (t1_60 - t0_60) / step60 + 1;
+
+	pool_init(n_threads);
+
+	struct celestial_body* sol = NULL;
+	int n_bodies = 0;
+	if (catalog_path != NULL) {
+		sol = catalog_map(catalog_path, &n_bodies);
+		if (sol == NULL) arghf("%s: not a body catalog (version %d)", catalog_path, CATALOG_VERSION);
+	} else {
+		sol = mksol(&n_bodies);
+	}
+	if (mpc_path != NULL) {
+		struct celestial_body* planets = sol;
+		sol = mpc_load(mpc_path, planets, &n_bodies, n_threads);
+		if (catalog_path == NULL) free(planets); // catalogs stay mapped
+	}
+
+	struct world world;
+	world_init(&world, sol, n_bodies);
+	world.t60 = t0_60;
+	if (nbody) {
+		world_set_nbody(&world, 1);
+		world.nbody.max_steps = INT_MAX;
+	}
+
+	FILE* out = stdout;
+	if (out_path != NULL) {
+		out = fopen(out_path, "wb");
+		if (out == NULL) arghf("%s: %s", out_path, strerror(errno));
+	} else {
+		out_path = "stdout";
+	}
+	setvbuf(out, NULL, _IOFBF, 1<<20);
+
+	struct csv_job csv;
+	memset(&csv, 0, sizeof(csv));
+	int n_chunks = (n_bodies + CSV_CHUNK - 1) / CSV_CHUNK;
+	if (binary) {
+		struct propagate_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, "YOPROP", 6);
+		h.version = PROPAGATE_VERSION;
+		h.n_bodies = n_bodies;
+		h.n_times = n_times;
+		h.t0_s = (double)t0_60 / 60.0;
+		h.step_s = (double)step60 / 60.0;
+		write_or_die(out, &h, sizeof(h), out_path);
+	} else {
+		csv.world = &world;
+		AN(csv.buf = calloc(n_chunks, sizeof(char*)));
+		AN(csv.len = calloc(n_chunks, sizeof(size_t)));
+		AN(csv.cap = calloc(n_chunks, sizeof(size_t)));
+		if (fputs("t_s,body,name,x_km,y_km\n", out) == EOF) arghf("%s: write error", out_path);
+	}
+
+	double t_propagate = 0;
+	double t_output = 0;
+	for (int64_t k = 0; k < n_times; k++) {
+		double t0 = now();
+		world.t60 = t0_60 + k * step60;
+		world_update_positions(&world);
+		double t1 = now();
+
+		double t_s = (double)world.t60 / 60.0;
+		if (binary) {
+			write_or_die(out, &t_s, sizeof(t_s), out_path);
+			write_or_die(out, world.kepler.x, n_bodies * sizeof(float), out_path);
+			write_or_die(out, world.kepler.y, n_bodies * sizeof(float), out_path);
+		} else {
+			csv.t_s_len = fmt_fixed3(csv.t_s, t_s);
+			pool_for(n_bodies, CSV_CHUNK, csv_task, &csv);
+			for (int c = 0; c < n_chunks; c++) write_or_die(out, csv.buf[c], csv.len[c], out_path);
+		}
+		double t2 = now();
+
+		t_propagate += t1 - t0;
+		t_output += t2 - t1;
+	}
+
+	if (fclose(out) != 0) arghf("%s: %s", out_path, strerror(errno));
+
+	fprintf(stderr, "%d bodies, %lld times, %d threads: propagate %.3f s (%.2f ns/body), output %.3f s\n",
+		n_bodies,
+		(long long)n_times,
+		pool_n_threads(),
+		t_propagate,
+		t_propagate * 1e9 / ((double)n_bodies * n_times),
+		t_output);
+
+	for (int c = 0; c < n_chunks && csv.buf != NULL; c++) free(csv.buf[c]);
+	free(csv.buf);
+	free(csv.len);
+	free(csv.cap);
+	pool_shutdown();
+
+	return EXIT_SUCCESS;
+}
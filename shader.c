@@ -1,13 +1,181 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "shader.h"
 #include "a.h"
 
+// program binary file version; bump when the layout changes
+#define SHADER_CACHE_VERSION (1)
+static const char shader_cache_magic[8] = "YOSHBIN";
+
+static struct {
+	char dir[1024]; // empty: no cache
+	char driver[1024]; // vendor/renderer/version; binaries are only valid for the driver that made them
+} cache;
+
+static uint64_t fnv1a(uint64_t h, const void* data, size_t n)
+{
+	const unsigned char* p = data;
+	for (size_t i = 0; i < n; i++) {
+		h ^= p[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static uint64_t fnv1a_str(uint64_t h, const char* s)
+{
+	return fnv1a(h, s, strlen(s) + 1); // +1: "ab","c" != "a","bc"
+}
+
+void shader_cache_init(const char* dir)
+{
+	memset(&cache, 0, sizeof(cache));
+
+	if (GLEW_KHR_parallel_shader_compile) {
+		// as many compiler threads as the driver likes
+		glMaxShaderCompilerThreadsKHR(0xffffffff); CHKGL;
+	}
+
+	snprintf(cache.driver, sizeof(cache.driver), "%s\n%s\n%s",
+		(const char*)glGetString(GL_VENDOR),
+		(const char*)glGetString(GL_RENDERER),
+		(const char*)glGetString(GL_VERSION)); CHKGL;
+
+	if (!GLEW_ARB_get_program_binary) return;
+	GLint n_formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &n_formats); CHKGL;
+	if (n_formats == 0) return;
+
+	if (dir == NULL) {
+		const char* xdg = getenv("XDG_CACHE_HOME");
+		const char* home = getenv("HOME");
+		if (xdg != NULL && xdg[0] == '/') {
+			snprintf(cache.dir, sizeof(cache.dir), "%s/yearone", xdg);
+		} else if (home != NULL && home[0] != 0) {
+			snprintf(cache.dir, sizeof(cache.dir), "%s/.cache", home);
+			mkdir(cache.dir, 0755);
+			snprintf(cache.dir, sizeof(cache.dir), "%s/.cache/yearone", home);
+		} else {
+			return;
+		}
+	} else {
+		snprintf(cache.dir, sizeof(cache.dir), "%s", dir);
+	}
+	if (mkdir(cache.dir, 0755) != 0 && errno != EEXIST) {
+		fprintf(stderr, "%s: %s; shader cache disabled\n", cache.dir, strerror(errno));
+		cache.dir[0] = 0;
+	}
+}
+
+static void cache_path(char* path, size_t n, uint64_t hash, const char* ext)
+{
+	snprintf(path, n, "%s/%016llx.%s", cache.dir, (unsigned long long)hash, ext);
+}
+
+/* file layout (host byte order):
+ *   char magic[8], uint32 version, uint32 format, uint64 hash,
+ *   uint32 length, then length bytes of program binary */
+
+// 1 if s->program was created and linked from the cache
+static int cache_load(struct shader* s)
+{
+	if (cache.dir[0] == 0) return 0;
+	char path[1100];
+	cache_path(path, sizeof(path), s->hash, "bin");
+	FILE* f = fopen(path, "rb");
+	if (f == NULL) return 0;
+
+	char magic[8];
+	uint32_t header[2];
+	uint64_t hash;
+	uint32_t length;
+	void* binary = NULL;
+	int ok =
+		fread(magic, sizeof(magic), 1, f) == 1 &&
+		fread(header, sizeof(header), 1, f) == 1 &&
+		fread(&hash, sizeof(hash), 1, f) == 1 &&
+		fread(&length, sizeof(length), 1, f) == 1 &&
+		memcmp(magic, shader_cache_magic, sizeof(magic)) == 0 &&
+		header[0] == SHADER_CACHE_VERSION &&
+		hash == s->hash &&
+		length > 0 &&
+		(binary = malloc(length)) != NULL &&
+		fread(binary, length, 1, f) == 1;
+	fclose(f);
+
+	if (ok) {
+		s->program = glCreateProgram(); CHKGL;
+		glProgramBinary(s->program, header[1], binary, length); CHKGL;
+		GLint status;
+		glGetProgramiv(s->program, GL_LINK_STATUS, &status); CHKGL;
+		// drivers reject binaries from other driver builds; not an error
+		ok = status == GL_TRUE;
+		if (!ok) {
+			glDeleteProgram(s->program);
+			s->program = 0;
+		}
+	} else {
+		fprintf(stderr, "%s: stale or corrupt shader cache; ignored\n", path);
+	}
+	free(binary);
+	return ok;
+}
+
+static void cache_save(struct shader* s)
+{
+	if (cache.dir[0] == 0) return;
+	GLint length = 0;
+	glGetProgramiv(s->program, GL_PROGRAM_BINARY_LENGTH, &length); CHKGL;
+	if (length <= 0) return;
+	void* binary;
+	AN(binary = malloc(length));
+	GLenum format;
+	glGetProgramBinary(s->program, length, &length, &format, binary); CHKGL;
+
+	// written aside and renamed, so concurrent runs never see half a file
+	char tmp_path[1100];
+	char path[1100];
+	cache_path(tmp_path, sizeof(tmp_path), s->hash, "tmp");
+	cache_path(path, sizeof(path), s->hash, "bin");
+	FILE* f = fopen(tmp_path, "wb");
+	if (f == NULL) {
+		perror(tmp_path);
+		free(binary);
+		return;
+	}
+	uint32_t header[] = {SHADER_CACHE_VERSION, format};
+	uint32_t length32 = length;
+	fwrite(shader_cache_magic, sizeof(shader_cache_magic), 1, f);
+	fwrite(header, sizeof(header), 1, f);
+	fwrite(&s->hash, sizeof(s->hash), 1, f);
+	fwrite(&length32, sizeof(length32), 1, f);
+	fwrite(binary, length, 1, f);
+	int err = ferror(f);
+	if (fclose(f) != 0 || err) {
+		fprintf(stderr, "%s: write error\n", tmp_path);
+		remove(tmp_path);
+	} else if (rename(tmp_path, path) != 0) {
+		perror(path);
+		remove(tmp_path);
+	}
+	free(binary);
+}
+
 static GLuint create_shader(GLenum type, const char* src)
 {
 	GLuint shader = glCreateShader(type); CHKGL;
 	glShaderSource(shader, 1, &src, 0);
 	glCompileShader(shader);
+	return shader;
+}
 
+static void check_shader(GLuint shader, GLenum type, const char* src)
+{
 	GLint status;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
 	if (status == GL_FALSE) {
@@ -18,22 +186,54 @@ static GLuint create_shader(GLenum type, const char* src)
 		const char* stype = type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "waaaat";
 		arghf("%s shader error: %s -- source:\n%s", stype, msg, src);
 	}
-	return shader;
 }
 
-void shader_init(struct shader* s, const char* vertex, const char* fragment)
+/* loads the program from the cache, or starts compiling and linking it;
+ * nothing here waits for the driver. takes ownership of the sources */
+static void program_begin(struct shader* s, char* vertex, char* fragment, const char* const* attributes, int n_attributes)
 {
-	GLuint vertex_shader = create_shader(GL_VERTEX_SHADER, vertex);
-	GLuint fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment);
+	uint64_t h = 0xcbf29ce484222325ULL;
+	h = fnv1a_str(h, cache.driver);
+	h = fnv1a_str(h, vertex);
+	h = fnv1a_str(h, fragment);
+	for (int i = 0; i < n_attributes; i++) h = fnv1a_str(h, attributes[i]);
+	s->hash = h;
+
+	if (cache_load(s)) {
+		free(vertex);
+		free(fragment);
+		return;
+	}
 
 	s->program = glCreateProgram(); CHKGL;
 
-	glAttachShader(s->program, vertex_shader);
-	glAttachShader(s->program, fragment_shader);
+	s->vertex_shader = create_shader(GL_VERTEX_SHADER, vertex);
+	s->fragment_shader = create_shader(GL_FRAGMENT_SHADER, fragment);
+	s->vertex_src = vertex;
+	s->fragment_src = fragment;
+
+	glAttachShader(s->program, s->vertex_shader);
+	glAttachShader(s->program, s->fragment_shader);
 
-	// glBindAttribLocation?!
+	for (int i = 0; i < n_attributes; i++) {
+		glBindAttribLocation(s->program, i, attributes[i]); CHKGL;
+	}
+
+	if (cache.dir[0] != 0) {
+		glProgramParameteri(s->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE); CHKGL;
+	}
 
 	glLinkProgram(s->program);
+	s->pending = 1;
+}
+
+void shader_finish(struct shader* s)
+{
+	if (!s->pending) return;
+	s->pending = 0;
+
+	check_shader(s->vertex_shader, GL_VERTEX_SHADER, s->vertex_src);
+	check_shader(s->fragment_shader, GL_FRAGMENT_SHADER, s->fragment_src);
 
 	GLint status;
 	glGetProgramiv(s->program, GL_LINK_STATUS, &status);
@@ -45,12 +245,121 @@ void shader_init(struct shader* s, const char* vertex, const char* fragment)
 		arghf("shader link error: %s", msg);
 	}
 
-	glDeleteShader(vertex_shader);
-	glDeleteShader(fragment_shader);
+	glDeleteShader(s->vertex_shader);
+	glDeleteShader(s->fragment_shader);
+	s->vertex_shader = s->fragment_shader = 0;
+	free(s->vertex_src);
+	free(s->fragment_src);
+	s->vertex_src = s->fragment_src = NULL;
+
+	cache_save(s);
+}
+
+static char* copy(const char* src)
+{
+	char* dst;
+	AN(dst = strdup(src));
+	return dst;
+}
+
+void shader_init(struct shader* s, const char* vertex, const char* fragment)
+{
+	memset(s, 0, sizeof(*s));
+	program_begin(s, copy(vertex), copy(fragment), NULL, 0);
 }
 
 void shader_use(struct shader* s)
 {
+	shader_finish(s);
 	glUseProgram(s->program);
 }
 
+void shader_permutations_init(
+	struct shader_permutations* p,
+	const struct shader_source* source,
+	const char* const* attributes,
+	int n_attributes,
+	const char* const* uniforms,
+	int n_uniforms)
+{
+	memset(p, 0, sizeof(*p));
+	p->source = source;
+	p->attributes = attributes;
+	p->n_attributes = n_attributes;
+	p->uniforms = uniforms;
+	p->n_uniforms = n_uniforms;
+	p->n_keys = 1;
+	for (int i = 0; i < source->n_defines; i++) p->n_keys *= source->define_n_values[i];
+	AN(p->shaders = calloc(p->n_keys, sizeof(struct shader)));
+}
+
+int shader_key(const struct shader_source* source, const int* values)
+{
+	// mixed radix; the first define varies fastest
+	int key = 0;
+	int stride = 1;
+	const int* declared = source->define_values;
+	for (int i = 0; i < source->n_defines; i++) {
+		int n = source->define_n_values[i];
+		int j = 0;
+		while (j < n && declared[j] != values[i]) j++;
+		if (j == n) arghf("%s: %s %d is not a declared permutation", source->name, source->define_names[i], values[i]);
+		key += j * stride;
+		stride *= n;
+		declared += n;
+	}
+	return key;
+}
+
+// src with the key's #defines inserted after its #version line
+static char* with_defines(const struct shader_source* source, const char* src, int key)
+{
+	char defines[1024];
+	int n = 0;
+	const int* declared = source->define_values;
+	for (int i = 0; i < source->n_defines; i++) {
+		int nv = source->define_n_values[i];
+		n += snprintf(defines + n, sizeof(defines) - n, "#define %s %d\n", source->define_names[i], declared[key % nv]);
+		ASSERT(n < (int)sizeof(defines));
+		key /= nv;
+		declared += nv;
+	}
+
+	const char* body = strchr(src, '\n');
+	ASSERT(strncmp(src, "#version", 8) == 0 && body != NULL);
+	body++;
+	size_t head = body - src;
+	size_t tail = strlen(body);
+	char* out;
+	AN(out = malloc(head + n + tail + 1));
+	memcpy(out, src, head);
+	memcpy(out + head, defines, n);
+	memcpy(out + head + n, body, tail + 1);
+	return out;
+}
+
+void shader_permutations_prepare(struct shader_permutations* p, int key)
+{
+	ASSERT(key >= 0 && key < p->n_keys);
+	struct shader* s = &p->shaders[key];
+	if (s->program != 0) return;
+	char* vertex = with_defines(p->source, p->source->vertex, key);
+	char* fragment = with_defines(p->source, p->source->fragment, key);
+	program_begin(s, vertex, fragment, p->attributes, p->n_attributes);
+}
+
+struct shader* shader_permutations_use(struct shader_permutations* p, int key)
+{
+	ASSERT(key >= 0 && key < p->n_keys);
+	struct shader* s = &p->shaders[key];
+	shader_permutations_prepare(p, key);
+	if (s->uniforms == NULL) {
+		shader_finish(s);
+		AN(s->uniforms = malloc((p->n_uniforms + 1) * sizeof(GLint))); // +1: never malloc(0)
+		for (int i = 0; i < p->n_uniforms; i++) {
+			s->uniforms[i] = glGetUniformLocation(s->program, p->uniforms[i]); CHKGL;
+		}
+	}
+	shader_use(s);
+	return s;
+}
@@ -1,13 +1,79 @@
 #ifndef SHADER_H
 #define SHADER_H
 
+#include <stdint.h>
+
 #include <GL/glew.h>
 
+/* programs are compiled asynchronously: shader_init() and
+ * shader_permutations_prepare() only start compiling and linking, and the
+ * first shader_use() (or shader_finish()) waits for the result. starting
+ * all programs before using any lets drivers with KHR_parallel_shader_compile
+ * build them concurrently.
+ *
+ * with ARB_get_program_binary, linked programs are cached on disk (see
+ * shader_cache_init()) under a hash of their sources, attribute bindings
+ * and the GL vendor/renderer/version strings, and later runs load them
+ * instead of compiling; anything the driver rejects is compiled from
+ * source again */
+
 struct shader {
 	GLuint program;
+	GLint* uniforms; // for permutations; indexed like their uniform names
+
+	// while pending; see shader_finish()
+	int pending;
+	GLuint vertex_shader;
+	GLuint fragment_shader;
+	char* vertex_src;
+	char* fragment_src;
+	uint64_t hash;
 };
 
+// dir==NULL: $XDG_CACHE_HOME/yearone or ~/.cache/yearone; call after glewInit()
+void shader_cache_init(const char* dir);
+
 void shader_init(struct shader*, const char* vertex, const char* fragment);
+void shader_finish(struct shader*);
 void shader_use(struct shader*);
 
+// a .glsl file with @define variants; see glsl2inc.pl
+struct shader_source {
+	const char* name;
+	const char* vertex;
+	const char* fragment;
+	int n_defines;
+	const char* const* define_names;
+	const int* define_n_values;
+	const int* define_values; // all defines' values, in declaration order
+};
+
+/* the permutations of a shader_source, each compiled on first use with its
+ * defines folded in. attributes are bound to locations 0..n_attributes-1
+ * in every permutation; uniform locations are looked up once per
+ * permutation into shader.uniforms */
+struct shader_permutations {
+	const struct shader_source* source;
+	const char* const* attributes;
+	int n_attributes;
+	const char* const* uniforms;
+	int n_uniforms;
+	int n_keys;
+	struct shader* shaders; // by key; program 0 until started
+};
+
+void shader_permutations_init(
+	struct shader_permutations*,
+	const struct shader_source*,
+	const char* const* attributes,
+	int n_attributes,
+	const char* const* uniforms,
+	int n_uniforms);
+// key of the permutation with one value per define, in declaration order
+int shader_key(const struct shader_source*, const int* values);
+// starts compiling a permutation that will be needed soon
+void shader_permutations_prepare(struct shader_permutations*, int key);
+// compiles the permutation if needed, then uses it
+struct shader* shader_permutations_use(struct shader_permutations*, int key);
+
 #endif/*SHADER_H*/
@@ -0,0 +1,56 @@
+#include <string.h>
+
+#include "a.h"
+#include "simclock.h"
+
+void simclock_init(struct simclock* clock, int64_t t60, int64_t step60, int max_steps, double warp)
+{
+	ASSERT(step60 > 0 && max_steps > 0);
+	memset(clock, 0, sizeof(*clock));
+	clock->t60 = t60;
+	clock->step60 = step60;
+	clock->max_steps = max_steps;
+	clock->warp = warp;
+}
+
+void simclock_set_step(struct simclock* clock, int64_t step60, int max_steps)
+{
+	ASSERT(step60 > 0 && max_steps > 0);
+	clock->t60 = simclock_render_t60(clock);
+	clock->acc60 = 0;
+	clock->step60 = step60;
+	clock->max_steps = max_steps;
+}
+
+int simclock_advance(struct simclock* clock, double dt)
+{
+	if (clock->paused) return 0;
+
+	clock->acc60 += dt * clock->warp * 60.0;
+
+	double step60 = (double)clock->step60;
+	int64_t n = (int64_t)(clock->acc60 / step60); // towards zero
+	int64_t max = clock->max_steps;
+	double dropped60 = 0; // signed, like warp
+	if (n > max || n < -max) {
+		int64_t capped = n > 0 ? max : -max;
+		dropped60 = (double)(n - capped) * step60;
+		clock->dropped60 += (n - capped) * clock->step60 * (n > 0 ? 1 : -1);
+		clock->acc60 -= dropped60;
+		n = capped;
+	}
+	if (dt > 0) clock->dropped_warp += (dropped60 / (60.0 * dt) - clock->dropped_warp) * 0.1;
+	clock->t60 += n * clock->step60;
+	clock->acc60 -= (double)n * step60;
+	return n > 0 ? n : -n;
+}
+
+void simclock_step(struct simclock* clock)
+{
+	clock->t60 += clock->warp < 0 ? -clock->step60 : clock->step60;
+}
+
+int64_t simclock_render_t60(struct simclock* clock)
+{
+	return clock->t60 + (int64_t)clock->acc60;
+}
@@ -0,0 +1,42 @@
+#ifndef SIMCLOCK_H
+#define SIMCLOCK_H
+
+#include <stdint.h>
+#include <limits.h>
+
+/* fixed-step simulation clock. wall time is scaled by warp and accumulated;
+ * whole steps of step60 are taken from the accumulator, at most max_steps
+ * per frame. time beyond that is dropped, so that costly steps (n-body) can't
+ * start a spiral; when steps are free, max_steps is SIMCLOCK_UNCAPPED and
+ * nothing is dropped. what's left over is the interpolation point between
+ * the latest step and the next one */
+
+#define SIMCLOCK_UNCAPPED (INT_MAX)
+
+struct simclock {
+	int64_t t60; // time of the latest step
+	int64_t step60;
+	double warp; // simulated seconds per wall second; negative runs backwards
+	int max_steps;
+	int paused;
+
+	double acc60; // simulated time not yet stepped; |acc60| < step60
+	int64_t dropped60; // total time dropped by the max_steps cap
+	double dropped_warp; // time dropped per wall second, smoothed over frames; warp minus this is what is shown
+};
+
+void simclock_init(struct simclock* clock, int64_t t60, int64_t step60, int max_steps, double warp);
+
+// restarts stepping from the current render time with a new step length
+void simclock_set_step(struct simclock* clock, int64_t step60, int max_steps);
+
+// adds dt seconds of wall time; returns the number of steps taken
+int simclock_advance(struct simclock* clock, double dt);
+
+// one step in the direction of warp; for stepping while paused
+void simclock_step(struct simclock* clock);
+
+// time to render at: t60 plus the accumulator
+int64_t simclock_render_t60(struct simclock* clock);
+
+#endif/*SIMCLOCK_H*/
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "a.h"
 #include "m.h"
@@ -30,8 +31,8 @@ int level;
 int n_bodies;
 int n_chars;
 
-void* blob;
 char* chars;
+uint32_t chars_offset; // of chars in sol_names
 static struct celestial_body* bodies;
 static struct celestial_body* cbody;
 static struct celestial_body* cbody_stack[MAX_LEVELS];
@@ -40,37 +41,64 @@ static int* cflags;
 static int cflags_stack[MAX_LEVELS];
 static int expected_cflags_stack[MAX_LEVELS];
 
-struct swoozle {
-	int level;
-	int n;
-}* swoozle;
+/* bodies are emitted depth-first; the count pass records each body's
+ * depth-first parent, from which the make pass knows every body's
+ * breadth-first index up front (perm), so it writes them in place */
+static int* dfs_parent;
+static int dfs_parent_max;
+static int* perm;
+static int dfs_stack[MAX_LEVELS];
 
 static void rgb(float r, float g, float b);
 static void mock_radius(float r);
 
+static int class_kepler_solver[CBC_N] = {
+	[CBC_SUN] = KEPLER_ITERATIVE,
+	[CBC_PLANET] = KEPLER_ITERATIVE,
+	[CBC_MOON] = KEPLER_ITERATIVE,
+	[CBC_MINOR] = KEPLER_TABLE,
+};
+
+static void set_class(enum celestial_body_class class)
+{
+	if (cbody == NULL) return;
+	cbody->class = class;
+	cbody->kepler_solver = class_kepler_solver[class];
+}
+
 static void _begin(const char* name, int expected_cflags)
 {
 	ASSERT(mode == MODE_COUNT || mode == MODE_MK);
 
-	if (mode == MODE_MK) {
-		cbody = &bodies[n_bodies];
+	ASSERT(level >= 0 && level < MAX_LEVELS);
+
+	if (mode == MODE_COUNT) {
+		if (n_bodies == dfs_parent_max) {
+			dfs_parent_max = dfs_parent_max ? dfs_parent_max * 2 : 64;
+			AN(dfs_parent = realloc(dfs_parent, dfs_parent_max * sizeof(int)));
+		}
+		dfs_parent[n_bodies] = level > 0 ? dfs_stack[level - 1] : -1;
+	} else {
+		int i = perm[n_bodies];
+		cbody = &bodies[i];
+		cbody->parent = -1;
 		if (level > 0) {
 			struct celestial_body* parent = cbody_stack[level - 1];
-			if (parent->satellites == NULL) {
-				parent->satellites = cbody;
+			if (parent->n_satellites == 0) {
+				parent->first_satellite = i;
 			}
+			ASSERT(parent->first_satellite + parent->n_satellites == i);
 			parent->n_satellites++;
+			cbody->parent = parent - bodies;
 		}
 		cbody_stack[level] = cbody;
-		cbody->name = chars + n_chars;
-		strcpy(cbody->name, name);
+		cbody->name = chars_offset + n_chars;
+		strcpy(chars + n_chars, name);
 		rgb(1,0,1);
 		mock_radius(16);
-
-		swoozle[n_bodies].level = level;
-		swoozle[n_bodies].n = n_bodies;
 	}
 
+	dfs_stack[level] = n_bodies;
 	n_bodies++;
 	n_chars += strlen(name) + 1;
 
@@ -78,13 +106,13 @@ static void _begin(const char* name, int expected_cflags)
 	*cflags = 0;
 	expected_cflags_stack[level] = expected_cflags;
 
-	ASSERT(level >= 0 && level < MAX_LEVELS);
 	level++;
 }
 
 static void begin_sun(const char* name)
 {
 	_begin(name, MASS | RADIUS | SIDEREAL_ROTATION_PERIOD);
+	set_class(CBC_SUN);
 	if (cbody == NULL) return;
 	cbody->renderer = CBR_SUN;
 }
@@ -99,11 +127,13 @@ static void _begin_body(const char* name)
 static void begin_planet(const char* name)
 {
 	_begin_body(name);
+	set_class(CBC_PLANET);
 }
 
 static void begin_moon(const char* name)
 {
 	_begin_body(name);
+	set_class(CBC_MOON);
 }
 
 static void end()
@@ -455,47 +485,268 @@ static void emit_bodies()
 //#define DUMP_BODIES
 
 #ifdef DUMP_BODIES
-static void _celestial_body_dump_rec(struct celestial_body* bs, int n, int level)
+static void _celestial_body_dump_rec(struct celestial_body* bodies, int i0, int n, int level)
 {
-	if (bs == NULL) return;
-	for (int i = 0; i < n; i++) {
-		struct celestial_body* b = &bs[i];
+	for (int i = i0; i < i0 + n; i++) {
+		struct celestial_body* b = &bodies[i];
 		for (int l = 0; l < level; l++) printf("  ");
-		printf("%s : %e kg (%d)\n", b->name, b->mass_kg, b->n_satellites);
-		_celestial_body_dump_rec(b->satellites, b->n_satellites, level + 1);
+		printf("%s : %e kg (%d)\n", celestial_body_name(b), b->mass_kg, b->n_satellites);
+		_celestial_body_dump_rec(bodies, b->first_satellite, b->n_satellites, level + 1);
 	}
 }
 
-static void celestial_body_dump(struct celestial_body* b)
+static void celestial_body_dump(struct celestial_body* bodies)
 {
-	_celestial_body_dump_rec(b, 1, 0);
+	_celestial_body_dump_rec(bodies, 0, 1, 0);
 }
 #endif
 
 
-static int swoozle_cmp(const void* va, const void* vb)
+void sol_bfs_permutation(const int* parent, int n, int* perm)
+{
+	/* satellites of each body as a compressed adjacency list; child_start
+	 * is counted in, then turned into offsets by a prefix sum */
+	int* child_start = calloc(n + 2, sizeof(int));
+	int* children = malloc(n * sizeof(int));
+	int* queue = malloc(n * sizeof(int));
+	AN(child_start);
+	AN(children);
+	AN(queue);
+
+	int root = -1;
+	for (int i = 0; i < n; i++) {
+		if (parent[i] < 0) {
+			ASSERT(root < 0);
+			root = i;
+		} else {
+			ASSERT(parent[i] < n);
+			child_start[parent[i] + 2]++;
+		}
+	}
+	ASSERT(n == 0 || root >= 0);
+	for (int i = 2; i < n + 2; i++) child_start[i] += child_start[i-1];
+	for (int i = 0; i < n; i++) {
+		if (parent[i] >= 0) children[child_start[parent[i] + 1]++] = i;
+	}
+
+	int head = 0;
+	int tail = 0;
+	if (n > 0) queue[tail++] = root;
+	while (head < tail) {
+		int i = queue[head];
+		perm[i] = head++;
+		for (int c = child_start[i]; c < child_start[i+1]; c++) queue[tail++] = children[c];
+	}
+	ASSERT(tail == n); // every body reachable from the root
+
+	free(child_start);
+	free(children);
+	free(queue);
+}
+
+int sol_elements_generation;
+
+static struct {
+	char* data;
+	size_t size;
+	size_t cap; // 0: data is someone else's (or empty)
+} names;
+
+const char* sol_names = "";
+
+char* sol_names_reserve(size_t n, uint32_t* offsetp)
+{
+	if (names.size == 0) {
+		// offset 0 is ""
+		AN(names.data = malloc(4096));
+		names.data[0] = 0;
+		names.size = 1;
+		names.cap = 4096;
+	}
+	if (names.size + n > names.cap) {
+		size_t cap = names.cap > 0 ? names.cap * 2 : 4096;
+		while (cap < names.size + n) cap *= 2;
+		char* data;
+		AN(data = malloc(cap));
+		memcpy(data, names.data, names.size);
+		if (names.cap > 0) free(names.data);
+		names.data = data;
+		names.cap = cap;
+	}
+	ASSERT(names.size + n <= UINT32_MAX);
+	*offsetp = names.size;
+	names.size += n;
+	sol_names = names.data;
+	return names.data + *offsetp;
+}
+
+int sol_names_map(const char* strings, size_t size)
+{
+	ASSERT(size > 0 && strings[0] == 0);
+	if (names.size > 0) return 0;
+	names.data = (char*)strings;
+	names.size = size;
+	names.cap = 0;
+	sol_names = names.data;
+	return 1;
+}
+
+void celestial_body_compute_derived(struct celestial_body* bodies, int i)
+{
+	struct celestial_body* body = &bodies[i];
+	double a = body->semi_major_axis_km;
+	double e = body->eccentricity;
+	body->sqrt_1me2 = sqrt(1 - e*e);
+	body->semi_minor_axis_km = a * body->sqrt_1me2;
+	body->cos_lop = cosf(body->longitude_of_periapsis_rad);
+	body->sin_lop = sinf(body->longitude_of_periapsis_rad);
+	body->M0_rad = body->mean_longitude_j2000_rad - body->longitude_of_periapsis_rad;
+	if (body->parent >= 0) {
+		double mu = G * (double)bodies[body->parent].mass_kg;
+		body->mean_motion_rad_s = sqrt(mu / (a*a*a));
+	} else {
+		body->mean_motion_rad_s = 0;
+	}
+}
+
+void celestial_body_update_derived(struct celestial_body* bodies, int i)
+{
+	celestial_body_compute_derived(bodies, i);
+	sol_elements_generation++;
+}
+
+void celestial_body_set_elements(
+	struct celestial_body* bodies,
+	int i,
+	float semi_major_axis_km,
+	float eccentricity,
+	float longitude_of_periapsis_rad,
+	float mean_longitude_j2000_rad)
+{
+	struct celestial_body* body = &bodies[i];
+	body->semi_major_axis_km = semi_major_axis_km;
+	body->eccentricity = eccentricity;
+	body->longitude_of_periapsis_rad = longitude_of_periapsis_rad;
+	body->mean_longitude_j2000_rad = mean_longitude_j2000_rad;
+	celestial_body_update_derived(bodies, i);
+}
+
+void sol_set_class_kepler_solver(struct celestial_body* bodies, int n, enum celestial_body_class class, int solver)
+{
+	ASSERT(class >= 0 && class < CBC_N);
+	class_kepler_solver[class] = solver;
+	for (int i = 0; i < n; i++) {
+		if (bodies[i].class == class) bodies[i].kepler_solver = solver;
+	}
+	sol_elements_generation++;
+}
+
+void celestial_body_set_mass(struct celestial_body* bodies, int i, float mass_kg)
+{
+	// satellite mean motions depend on our mass
+	struct celestial_body* body = &bodies[i];
+	body->mass_kg = mass_kg;
+	for (int j = 0; j < body->n_satellites; j++) {
+		celestial_body_update_derived(bodies, body->first_satellite + j);
+	}
+}
+
+static inline int shift(int i, int at, int d)
+{
+	return i >= at ? i + d : i;
+}
+
+struct celestial_body* sol_insert_satellites(
+	struct celestial_body* bodies,
+	int* n_bodiesp,
+	int parent,
+	int n,
+	enum celestial_body_class class,
+	int* firstp)
 {
-	const struct swoozle* a = va;
-	const struct swoozle* b = vb;
-	int d1 = a->level - b->level;
-	if (d1 != 0) return d1;
-	return a->n - b->n;
+	int n_bodies = *n_bodiesp;
+	ASSERT(parent >= 0 && parent < n_bodies);
+	ASSERT(n >= 0);
+
+	// satellites of parent go after those of earlier bodies and before
+	// those of later bodies
+	struct celestial_body* p = &bodies[parent];
+	int at = n_bodies;
+	if (p->n_satellites > 0) {
+		at = p->first_satellite + p->n_satellites;
+	} else {
+		for (int i = parent + 1; i < n_bodies; i++) {
+			if (bodies[i].n_satellites > 0) {
+				at = bodies[i].first_satellite;
+				break;
+			}
+		}
+	}
+
+	size_t sz = sizeof(struct celestial_body);
+	struct celestial_body* nb = malloc((n_bodies + n) * sz);
+	AN(nb);
+	memcpy(nb, bodies, at * sz);
+	memset(nb + at, 0, n * sz);
+	memcpy(nb + at + n, bodies + at, (n_bodies - at) * sz);
+
+	for (int i = 0; i < n_bodies + n; i++) {
+		if (i >= at && i < at + n) continue;
+		if (nb[i].n_satellites > 0) nb[i].first_satellite = shift(nb[i].first_satellite, at, n);
+		if (nb[i].parent >= 0) nb[i].parent = shift(nb[i].parent, at, n);
+	}
+
+	struct celestial_body* np = &nb[parent];
+	if (np->n_satellites == 0) np->first_satellite = at;
+	np->n_satellites += n;
+	for (int i = at; i < at + n; i++) {
+		nb[i].parent = parent;
+		nb[i].class = class;
+		nb[i].kepler_solver = class_kepler_solver[class];
+	}
+
+	*n_bodiesp = n_bodies + n;
+	if (firstp != NULL) *firstp = at;
+	sol_elements_generation++;
+	return nb;
 }
 
-static void set_parents_rec(struct celestial_body* body, struct celestial_body* parent)
+void sol_remove_satellites(struct celestial_body* bodies, int* n_bodiesp, int parent, int n)
 {
-	body->parent = parent;
-	for (int i = 0; i < body->n_satellites; i++) {
-		set_parents_rec(&body->satellites[i], body);
+	int n_bodies = *n_bodiesp;
+	struct celestial_body* p = &bodies[parent];
+	ASSERT(n >= 0 && n <= p->n_satellites);
+	if (n == 0) return;
+
+	int end = p->first_satellite + p->n_satellites;
+	for (int i = end - n; i < end; i++) AZ(bodies[i].n_satellites);
+
+	memmove(bodies + end - n, bodies + end, (n_bodies - end) * sizeof(struct celestial_body));
+	n_bodies -= n;
+	for (int i = 0; i < n_bodies; i++) {
+		if (bodies[i].n_satellites > 0) bodies[i].first_satellite = shift(bodies[i].first_satellite, end, -n);
+		if (bodies[i].parent >= 0) bodies[i].parent = shift(bodies[i].parent, end, -n);
 	}
+	p->n_satellites -= n;
+
+	*n_bodiesp = n_bodies;
+	sol_elements_generation++;
 }
 
-struct celestial_body* mksol()
+// the emitters' state; cbody still points into the previous call's array
+static void begin_pass(int m)
 {
-	mode = MODE_COUNT;
+	mode = m;
 	level = 0;
 	n_bodies = 0;
 	n_chars = 0;
+	cbody = NULL;
+	memset(cbody_stack, 0, sizeof(cbody_stack));
+}
+
+struct celestial_body* mksol(int* n_bodiesp)
+{
+	begin_pass(MODE_COUNT);
 	emit_bodies();
 
 	AZ(level);
@@ -505,56 +756,34 @@ struct celestial_body* mksol()
 	int save_n_bodies = n_bodies;
 	int save_n_chars = n_chars;
 
-	size_t bodies_sz = n_bodies * sizeof(struct celestial_body);
-	size_t total_sz = bodies_sz + n_chars;
-	blob = malloc(total_sz);
-	AN(blob);
-	memset(blob, 0, total_sz);
-	bodies = blob;
-	chars = (char*)blob + bodies_sz;
+	AN(perm = malloc(n_bodies * sizeof(int)));
+	sol_bfs_permutation(dfs_parent, n_bodies, perm);
+	free(dfs_parent);
+	dfs_parent = NULL;
+	dfs_parent_max = 0;
 
-	swoozle = malloc(n_bodies * sizeof(struct swoozle));
-	AN(swoozle);
+	AN(bodies = calloc(n_bodies, sizeof(struct celestial_body)));
+	chars = sol_names_reserve(n_chars, &chars_offset);
 
-	mode = MODE_MK;
-	level = 0;
-	n_bodies = 0;
-	n_chars = 0;
+	begin_pass(MODE_MK);
 	emit_bodies();
 
 	AZ(level);
 	ASSERT(n_bodies == save_n_bodies);
 	ASSERT(n_chars == save_n_chars);
 
-	// juggle stuff around so that bodies are in breadth-first order
-	// (otherwise celestial_body.satellites cannot function as an array)
-	struct celestial_body* bodies2 = malloc(bodies_sz);
-	AN(bodies2);
-	qsort(swoozle, n_bodies, sizeof(struct swoozle), swoozle_cmp);
-	for (int i = 0; i < n_bodies; i++) {
-		struct swoozle* si = &swoozle[i];
-		memcpy(&bodies2[i], &bodies[si->n], sizeof(struct celestial_body));
-		if (bodies2[i].satellites == NULL) continue;
-		for (int j = 0; j < n_bodies; j++) {
-			struct swoozle* sj = &swoozle[j];
-			int oi = bodies2[i].satellites - bodies;
-			if (oi == sj->n) {
-				bodies2[i].satellites = &bodies[j];
-				break;
-			}
-		}
-	}
-	memcpy(bodies, bodies2, bodies_sz);
-	free(swoozle);
-	free(bodies2);
+	free(perm);
+	perm = NULL;
 
-	set_parents_rec(bodies, NULL);
+	for (int i = 0; i < n_bodies; i++) celestial_body_update_derived(bodies, i);
 
 	#ifdef DUMP_BODIES
 	celestial_body_dump(bodies);
 	AZ(1);
 	#endif
 
+	if (n_bodiesp != NULL) *n_bodiesp = n_bodies;
+
 	return bodies;
 }
 
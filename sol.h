@@ -1,6 +1,9 @@
 #ifndef SOL_H
 #define SOL_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "m.h"
 
 #define AU_IN_KM (149597870.7)
@@ -10,9 +13,11 @@
 */
 
 struct celestial_body {
-	char* name;
-	struct celestial_body* satellites;
-	struct celestial_body* parent;
+	uint32_t name; // offset into sol_names; see celestial_body_name()
+	// indices into the body array; satellites are
+	// [first_satellite;first_satellite+n_satellites)
+	int parent; // -1 for the root
+	int first_satellite;
 	int n_satellites;
 	float mass_kg;
 	float mock_radius;
@@ -25,16 +30,93 @@ struct celestial_body {
 	float color[3];
 	enum {
 		CBR_SUN,
-		CBR_BODY
+		CBR_BODY,
+		CBR_POINT // no orbit; drawn in bulk by render_points()
 	} renderer;
+	enum celestial_body_class {
+		CBC_SUN,
+		CBC_PLANET,
+		CBC_MOON,
+		CBC_MINOR,
+		CBC_N
+	} class;
+	enum {
+		KEPLER_ITERATIVE,
+		KEPLER_TABLE
+	} kepler_solver;
+
+	// derived from the elements above (and the parent's mass_kg) by
+	// celestial_body_update_derived(); never set these directly
+	double mean_motion_rad_s;
+	float M0_rad;
+	float semi_minor_axis_km;
+	float sqrt_1me2;
+	float cos_lop;
+	float sin_lop;
 
-	float render_x;
-	float render_y;
-	float render_radius;
-	float kepler_x;
-	float kepler_y;
+	// per-frame state (positions etc.) lives in struct world
 };
 
-struct celestial_body* mksol();
+/* body names, NUL-terminated, in one table shared by all body arrays so that
+ * bodies hold offsets instead of pointers (and catalogs can be used in
+ * place). offset 0 is always "", so zeroed bodies are unnamed. the table
+ * moves when names are added; don't keep pointers into it across that */
+extern const char* sol_names;
+
+static inline const char* celestial_body_name(const struct celestial_body* body)
+{
+	return sol_names + body->name;
+}
+
+// room for n more bytes of names at offset *offsetp; returns where to write them
+char* sol_names_reserve(size_t n, uint32_t* offsetp);
+// makes strings (size bytes, strings[0]==0) the table, in place; fails
+// (returns 0) if there are names already. a later sol_names_reserve() copies it
+int sol_names_map(const char* strings, size_t size);
+
+// returns the root of a breadth-first array of *n_bodiesp bodies
+struct celestial_body* mksol(int* n_bodiesp);
+
+/* bumped whenever derived elements change, so that copies of them (e.g.
+ * struct kepler_batch) know when to reload */
+extern int sol_elements_generation;
+
+void celestial_body_update_derived(struct celestial_body* bodies, int i);
+// same, but without bumping sol_elements_generation, so it may be called from
+// several threads at once; the caller bumps it when done
+void celestial_body_compute_derived(struct celestial_body* bodies, int i);
+void celestial_body_set_elements(
+	struct celestial_body* bodies,
+	int i,
+	float semi_major_axis_km,
+	float eccentricity,
+	float longitude_of_periapsis_rad,
+	float mean_longitude_j2000_rad);
+void celestial_body_set_mass(struct celestial_body* bodies, int i, float mass_kg);
+
+// changes kepler_solver of all bodies of a class, and the default for new ones
+void sol_set_class_kepler_solver(struct celestial_body* bodies, int n, enum celestial_body_class class, int solver);
+
+/* breadth-first order of a tree given as parent indices (-1 for the root),
+ * in linear time. perm[i] is the new index of body i; satellites keep their
+ * relative order, so each body's satellites end up contiguous */
+void sol_bfs_permutation(const int* parent, int n, int* perm);
+
+/* makes room for n leaf satellites of bodies[parent] after its existing ones,
+ * keeping the array breadth-first, in a new (malloc()ed) array; indices
+ * after the new bodies shift. bodies is not touched and stays the caller's
+ * to free (or unmap, for a catalog). the new bodies are zeroed except for
+ * parent, class and kepler_solver, and start at index *firstp of the
+ * returned array */
+struct celestial_body* sol_insert_satellites(
+	struct celestial_body* bodies,
+	int* n_bodiesp,
+	int parent,
+	int n,
+	enum celestial_body_class class,
+	int* firstp);
+
+// removes the last n satellites of bodies[parent], which must be leaves
+void sol_remove_satellites(struct celestial_body* bodies, int* n_bodiesp, int parent, int n);
 
 #endif/*SOL_H*/
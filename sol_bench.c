@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "a.h"
+#include "sol.h"
+
+/* sol_bench: time to put a depth-first emitted tree (as emit_bodies() makes
+ * it) into breadth-first order, from 20 to 1M bodies. "bfs" is
+ * sol_bfs_permutation(), which mksol() uses to place each body as it is
+ * emitted. "sort" is the old level sort followed by a linear search per
+ * satellite range; it is quadratic, so it is only run up to SORT_MAX
+ * bodies. last, mksol() itself, on the bodies of sol.c */
+
+#define SORT_MAX (1<<15)
+
+// a sun with ~sqrt(n) planets, and the rest as moons spread over them
+static void mktree(int n, int* parent, int* level)
+{
+	int n_planets = 1;
+	while (n_planets * n_planets < n) n_planets++;
+	if (n_planets > n - 1) n_planets = n - 1;
+	int n_moons = n - 1 - n_planets;
+
+	int i = 0;
+	parent[i] = -1;
+	level[i++] = 0;
+	for (int p = 0; p < n_planets; p++) {
+		int pi = i;
+		parent[i] = 0;
+		level[i++] = 1;
+		int m1 = (int)((long long)n_moons * (p+1) / n_planets);
+		int m0 = (int)((long long)n_moons * p / n_planets);
+		for (int m = m0; m < m1; m++) {
+			parent[i] = pi;
+			level[i++] = 2;
+		}
+	}
+	ASSERT(i == n);
+}
+
+static double bench_bfs(const int* parent, int n, int* perm)
+{
+	double t0 = now();
+	sol_bfs_permutation(parent, n, perm);
+	return now() - t0;
+}
+
+// breadth-first: every body after its parent, and satellites contiguous,
+// i.e. in the order of their parents
+static void check_bfs(const int* parent, int n, const int* perm)
+{
+	int* inv = malloc(n * sizeof(int));
+	AN(inv);
+	for (int i = 0; i < n; i++) inv[i] = -1;
+	for (int i = 0; i < n; i++) {
+		ASSERT(perm[i] >= 0 && perm[i] < n && inv[perm[i]] == -1);
+		inv[perm[i]] = i;
+	}
+	ASSERT(parent[inv[0]] == -1);
+	int last_parent = 0;
+	for (int j = 1; j < n; j++) {
+		int p = parent[inv[j]];
+		ASSERT(p >= 0);
+		int pj = perm[p];
+		ASSERT(pj < j && pj >= last_parent);
+		last_parent = pj;
+	}
+	free(inv);
+}
+
+struct swoozle {
+	int level;
+	int n;
+};
+
+static int swoozle_cmp(const void* va, const void* vb)
+{
+	const struct swoozle* a = va;
+	const struct swoozle* b = vb;
+	int d1 = a->level - b->level;
+	if (d1 != 0) return d1;
+	return a->n - b->n;
+}
+
+// first_satellite of src is in depth-first indices
+static double bench_sort(const struct celestial_body* src, const int* level, int n, struct celestial_body* dst)
+{
+	double t0 = now();
+	struct swoozle* swoozle = malloc(n * sizeof(struct swoozle));
+	AN(swoozle);
+	for (int i = 0; i < n; i++) {
+		swoozle[i].level = level[i];
+		swoozle[i].n = i;
+	}
+	qsort(swoozle, n, sizeof(struct swoozle), swoozle_cmp);
+	for (int i = 0; i < n; i++) {
+		memcpy(&dst[i], &src[swoozle[i].n], sizeof(struct celestial_body));
+		if (dst[i].n_satellites == 0) continue;
+		for (int j = 0; j < n; j++) {
+			if (swoozle[j].n == dst[i].first_satellite) {
+				dst[i].first_satellite = j;
+				break;
+			}
+		}
+	}
+	free(swoozle);
+	return now() - t0;
+}
+
+int main(int argc, char** argv)
+{
+	const int sizes[] = {20, 100, 1000, 10000, 100000, 1000000};
+	const int n_sizes = sizeof(sizes) / sizeof(sizes[0]);
+
+	printf("%-10s %12s %12s %12s\n", "bodies", "bfs_ms", "bfs_ns/body", "sort_ms");
+	for (int s = 0; s < n_sizes; s++) {
+		int n = sizes[s];
+		int* parent = malloc(n * sizeof(int));
+		int* level = malloc(n * sizeof(int));
+		struct celestial_body* src = calloc(n, sizeof(struct celestial_body));
+		struct celestial_body* dst = calloc(n, sizeof(struct celestial_body));
+		int* perm = malloc(n * sizeof(int));
+		AN(perm);
+		AN(parent);
+		AN(level);
+		AN(src);
+		AN(dst);
+		mktree(n, parent, level);
+		for (int i = 0; i < n; i++) {
+			int p = parent[i];
+			if (p >= 0 && src[p].n_satellites++ == 0) src[p].first_satellite = i;
+		}
+
+		// best of a few runs; small trees are repeated to get above the timer
+		int repeat = n < 100000 ? 1000000 / n : 3;
+		double bfs = 1e30;
+		for (int r = 0; r < repeat; r++) {
+			double t = bench_bfs(parent, n, perm);
+			if (t < bfs) bfs = t;
+		}
+		check_bfs(parent, n, perm);
+
+		char sort_ms[32] = "-";
+		if (n <= SORT_MAX) {
+			double sort = 1e30;
+			for (int r = 0; r < (repeat < 10 ? repeat : 10); r++) {
+				double t = bench_sort(src, level, n, dst);
+				if (t < sort) sort = t;
+			}
+			snprintf(sort_ms, sizeof(sort_ms), "%.3f", sort * 1e3);
+		}
+
+		printf("%-10d %12.3f %12.2f %12s\n", n, bfs * 1e3, bfs * 1e9 / n, sort_ms);
+
+		free(parent);
+		free(level);
+		free(src);
+		free(dst);
+		free(perm);
+	}
+
+	{
+		int n = 0;
+		double best = 1e30;
+		for (int r = 0; r < 1000; r++) {
+			double t0 = now();
+			struct celestial_body* bodies = mksol(&n);
+			double t = now() - t0;
+			if (t < best) best = t;
+			ASSERT(bodies[0].parent == -1);
+			for (int i = 1; i < n; i++) {
+				int p = bodies[i].parent;
+				ASSERT(p >= 0 && p < i && bodies[p].first_satellite <= i && i < bodies[p].first_satellite + bodies[p].n_satellites);
+			}
+			free(bodies);
+		}
+		printf("mksol: %d bodies in %.3f ms\n", n, best * 1e3);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,17 +1,22 @@
+@define AA 0 1 3
 @vert
 #version 130
 
 attribute vec2 a_position;
 
+// per instance
+attribute vec3 a_body; // offset (pixels), radius (pixels)
+
 varying vec2 v_position;
+varying float v_mu;
 
-uniform vec2 u_offset;
-uniform vec2 u_scale;
+uniform vec2 u_ndc; // pixels to NDC
 
 void main()
 {
 	v_position = a_position;
-	gl_Position = vec4(a_position * u_scale + u_offset, 0, 1);
+	v_mu = 4.0/(a_body.z*6.0);
+	gl_Position = vec4((a_body.xy + a_position * a_body.z) * u_ndc, 0, 1);
 }
 
 
@@ -19,15 +24,31 @@ void main()
 #version 130
 
 varying vec2 v_position;
-uniform float u_mu;
+varying float v_mu;
+
+/* AA is the supersampling radius, for (2AA+1)^2 samples per fragment, or
+ * 0 for one sample with its edges ramped over the 7x7 footprint. all tiers
+ * keep the original 7x7 normalisation, sum/36, i.e. a GAIN of 49/36 */
+const float GAIN = 49.0/36.0;
+const float FOOTPRINT = 7.0; // in units of mu
 
 void main(void)
 {
-	const float N = 3;
+#if AA == 0
+	// r is the squared radius, so the footprint is 2*sqrt(r) times wider in r
+	float r = dot(v_position, v_position);
+	float w = 2*sqrt(r) * FOOTPRINT * v_mu + 1e-6;
+	vec4 inner = vec4(1,1,1-r,1);
+	vec4 outer = vec4(0.8-r,0.6-r,0.5-r,1);
+	vec4 color = mix(inner, outer, clamp((r - 0.4) / w + 0.5, 0, 1));
+	float coverage = clamp((0.95 - r) / w + 0.5, 0, 1);
+	gl_FragColor = color * (coverage * GAIN);
+#else
+	const float N = AA;
 	vec4 color = vec4(0,0,0,0);
 	for (float dy = -N; dy <= N; dy++) {
 		for (float dx = -N; dx <= N; dx++) {
-			vec2 spos = v_position + vec2(dx*u_mu,dy*u_mu);
+			vec2 spos = v_position + vec2(dx*v_mu,dy*v_mu);
 			float r = dot(spos, spos);
 			if (r < 0.4) {
 				color += vec4(1,1,1-r,1);
@@ -36,7 +57,8 @@ void main(void)
 			}
 		}
 	}
-	gl_FragColor = color / float(N*N*4);
+	gl_FragColor = color * (GAIN / ((2*N+1)*(2*N+1)));
+#endif
 }
 
 
@@ -20,7 +20,7 @@ struct font* font_ter24;
 
 static struct font _font_ter24;
 
-void fonts_init()
+void fonts_load()
 {
 	_font_ter24.bitmap_width = ter_u24n_bitmap_width;
 	_font_ter24.bitmap_height = ter_u24n_bitmap_height;
@@ -29,6 +29,12 @@ void fonts_init()
 	_font_ter24.size = ter_u24n_size;
 	_font_ter24.meta = ter_u24n_meta;
 	_font_ter24.data = ter_u24n_data;
+	font_ter24 = &_font_ter24;
+}
+
+void fonts_init()
+{
+	fonts_load();
 
 	glGenTextures(1, &_font_ter24.texture); CHKGL;
 	glBindTexture(GL_TEXTURE_2D, _font_ter24.texture); CHKGL;
@@ -37,11 +43,9 @@ void fonts_init()
 	glTexImage2D(GL_TEXTURE_2D, level, 1, _font_ter24.bitmap_width, _font_ter24.bitmap_height, border, GL_RED, GL_UNSIGNED_BYTE, _font_ter24.data); CHKGL;
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST); CHKGL;
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST); CHKGL;
-
-	font_ter24 = &_font_ter24;
 }
 
-static int* font_find_meta(struct font* font, int variant, int codepoint)
+int* font_find_meta(struct font* font, int variant, int codepoint)
 {
 	int imin = 0;
 	int imax = font->n_meta-1;
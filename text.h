@@ -18,8 +18,14 @@ struct font {
 
 extern struct font* font_ter24;
 
+// fonts_load() only sets up the glyph tables; fonts_init() also uploads the
+// textures, and needs a GL context
+void fonts_load();
 void fonts_init();
 
+// glyph {variant, codepoint, u, v, w, h}, or NULL
+int* font_find_meta(struct font* font, int variant, int codepoint);
+
 struct text {
 	struct shader shader;
 	GLuint a_position;
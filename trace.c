@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "trace.h"
+
+struct trace_event {
+	uint64_t ns;
+	const char* name;
+	char ph; // 'B' or 'E'
+};
+
+struct trace_ring {
+	uint64_t head; // written by the owner only
+	const char* name;
+	struct trace_event events[TRACE_RING_EVENTS];
+};
+
+int trace_enabled;
+
+static struct trace_ring rings[TRACE_MAX_THREADS];
+static int n_rings;
+static __thread struct trace_ring* ring;
+static __thread int registered;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static struct trace_ring* get_ring()
+{
+	if (!registered) {
+		registered = 1;
+		int i = __atomic_fetch_add(&n_rings, 1, __ATOMIC_RELAXED);
+		// threads beyond TRACE_MAX_THREADS aren't traced
+		ring = i < TRACE_MAX_THREADS ? &rings[i] : NULL;
+	}
+	return ring;
+}
+
+static void record(const char* name, char ph)
+{
+	struct trace_ring* r = get_ring();
+	if (r == NULL) return;
+	uint64_t head = r->head;
+	struct trace_event* e = &r->events[head & (TRACE_RING_EVENTS-1)];
+	e->ns = now_ns();
+	e->name = name;
+	e->ph = ph;
+	__atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_begin(const char* name)
+{
+	record(name, 'B');
+}
+
+void trace_end(const char* name)
+{
+	record(name, 'E');
+}
+
+void trace_set_thread_name(const char* name)
+{
+	struct trace_ring* r = get_ring();
+	if (r != NULL) r->name = name;
+}
+
+int trace_dump(const char* path)
+{
+	FILE* f = fopen(path, "w");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	int n = __atomic_load_n(&n_rings, __ATOMIC_ACQUIRE);
+	if (n > TRACE_MAX_THREADS) n = TRACE_MAX_THREADS;
+
+	// timestamps are relative to the oldest event kept
+	uint64_t t0 = UINT64_MAX;
+	for (int i = 0; i < n; i++) {
+		uint64_t head = __atomic_load_n(&rings[i].head, __ATOMIC_ACQUIRE);
+		if (head == 0) continue;
+		uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+		uint64_t ns = rings[i].events[first & (TRACE_RING_EVENTS-1)].ns;
+		if (ns < t0) t0 = ns;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	int comma = 0;
+	for (int i = 0; i < n; i++) {
+		struct trace_ring* r = &rings[i];
+		if (r->name != NULL) {
+			fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}\n", comma ? "," : "", i, r->name);
+			comma = 1;
+		}
+		uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+		for (uint64_t k = first; k < head; k++) {
+			struct trace_event* e = &r->events[k & (TRACE_RING_EVENTS-1)];
+			if (e->name == NULL || e->ns < t0) continue;
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}\n",
+				comma ? "," : "",
+				e->name,
+				e->ph,
+				(double)(e->ns - t0) * 1e-3,
+				i);
+			comma = 1;
+		}
+	}
+	fprintf(f, "]}\n");
+
+	int error = ferror(f);
+	if (fclose(f) != 0 || error) {
+		fprintf(stderr, "%s: write error\n", path);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/* event tracing for timelines: begin/end events go into a fixed ring per
+ * thread (the oldest are overwritten), without locks or allocation, so it
+ * can stay on. trace_dump() writes the rings as Chrome trace-event JSON
+ * (chrome://tracing, ui.perfetto.dev). names must be string literals or
+ * otherwise outlive the trace, and need no JSON escaping */
+
+#define TRACE_MAX_THREADS (64)
+#define TRACE_RING_EVENTS (16384) // power of two
+
+extern int trace_enabled;
+
+void trace_begin(const char* name);
+void trace_end(const char* name);
+// name of the calling thread in the dump
+void trace_set_thread_name(const char* name);
+/* call while the other threads are idle, or their oldest events may be
+ * torn. returns 0, or -1 (with a message on stderr) if the file can't be
+ * written; tracing carries on either way */
+int trace_dump(const char* path);
+
+#define TRACE_BEGIN(name) do { if (trace_enabled) trace_begin(name); } while (0)
+#define TRACE_END(name) do { if (trace_enabled) trace_end(name); } while (0)
+
+#endif/*TRACE_H*/
@@ -1,7 +1,7 @@
 #ifndef UTF8_DECODE_H
 #define UTF8_DECODE_H
 
-int utf8_decode(char** c0z, int* n)
+static int utf8_decode(char** c0z, int* n)
 {
 	unsigned char** c0 = (unsigned char**)c0z;
 	if (*n <= 0) return -1;
@@ -0,0 +1,287 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "a.h"
+#include "world.h"
+
+void world_init(struct world* world, struct celestial_body* sol, int n_bodies)
+{
+	memset(world, 0, sizeof(*world));
+	world->sol = sol;
+	world->n_bodies = n_bodies;
+	kepler_batch_init(&world->kepler, sol, n_bodies);
+
+	AN(world->radius_km = calloc(n_bodies, sizeof(float)));
+	AN(world->mock_radius = calloc(n_bodies, sizeof(float)));
+	AN(world->render_x = calloc(n_bodies, sizeof(float)));
+	AN(world->render_y = calloc(n_bodies, sizeof(float)));
+	AN(world->render_radius = calloc(n_bodies, sizeof(float)));
+	AN(world->renderer = calloc(n_bodies, sizeof(uint8_t)));
+	AN(world->reach_km = calloc(n_bodies, sizeof(float)));
+	AN(world->reach_px = calloc(n_bodies, sizeof(float)));
+	AN(world->visible = calloc(n_bodies, sizeof(int)));
+	AN(world->ring_order = calloc(n_bodies, sizeof(int)));
+	AN(world->ring_inner_km = calloc(n_bodies, sizeof(float)));
+	AN(world->ring_outer_km = calloc(n_bodies, sizeof(float)));
+	AN(world->ring_block_inner_km = calloc(n_bodies, sizeof(float)));
+	AN(world->ring_block_outer_km = calloc(n_bodies, sizeof(float)));
+	AN(world->ring_candidates = calloc(n_bodies, sizeof(int)));
+	AN(world->visible_stamp = calloc(n_bodies, sizeof(int)));
+	for (int i = 0; i < n_bodies; i++) {
+		world->radius_km[i] = sol[i].radius_km;
+		world->mock_radius[i] = sol[i].mock_radius;
+		world->renderer[i] = sol[i].renderer;
+	}
+	world->bounds_generation = sol_elements_generation - 1;
+}
+
+double world_t1(struct world* world)
+{
+	return (double)world->t60 / 60.0;
+}
+
+void world_set_nbody(struct world* world, int enable)
+{
+	if (enable == world->use_nbody) return;
+	if (enable) {
+		nbody_init(&world->nbody, world->sol, world->n_bodies, world->t60);
+	} else {
+		nbody_free(&world->nbody);
+	}
+	world->use_nbody = enable;
+}
+
+void world_update_positions(struct world* world)
+{
+	struct kepler_batch* kb = &world->kepler;
+	if (world->use_nbody) {
+		nbody_advance(&world->nbody, world->t60);
+		nbody_positions(&world->nbody, world->t60, kb->x, kb->y);
+	} else if (world->use_ephem) {
+		ephem_propagate(&world->ephem, world_t1(world), kb->x, kb->y);
+	} else {
+		kepler_batch_propagate(kb, world_t1(world));
+	}
+}
+
+// slack on reach_km for ephemeris fit error and N-body perturbations of
+// otherwise keplerian orbits
+#define REACH_SLACK (1.0625f)
+
+struct ring_entry {
+	float inner_km;
+	int body;
+};
+
+static int ring_entry_cmp(const void* va, const void* vb)
+{
+	const struct ring_entry* a = va;
+	const struct ring_entry* b = vb;
+	return a->inner_km < b->inner_km ? -1 : a->inner_km > b->inner_km;
+}
+
+static int int_cmp(const void* va, const void* vb)
+{
+	int a = *(const int*)va;
+	int b = *(const int*)vb;
+	return a < b ? -1 : a > b;
+}
+
+static void world_update_rings(struct world* world, int parent)
+{
+	const struct celestial_body* p = &world->sol[parent];
+	int first = p->first_satellite;
+	int n = p->n_satellites;
+	struct ring_entry* entries;
+	AN(entries = malloc(n * sizeof(struct ring_entry)));
+	for (int k = 0; k < n; k++) {
+		int i = first + k;
+		const struct celestial_body* body = &world->sol[i];
+		float periapsis_km = body->semi_major_axis_km * (1 - body->eccentricity);
+		float apoapsis_km = body->semi_major_axis_km * (1 + body->eccentricity);
+		entries[k].inner_km = periapsis_km / REACH_SLACK - world->reach_km[i];
+		entries[k].body = i;
+		world->ring_outer_km[i] = (apoapsis_km + world->reach_km[i]) * REACH_SLACK; // by body; permuted below
+	}
+	qsort(entries, n, sizeof(struct ring_entry), ring_entry_cmp);
+
+	// outer radii by body go to a scratch copy before being overwritten in sorted order
+	float* outer;
+	AN(outer = malloc(n * sizeof(float)));
+	memcpy(outer, &world->ring_outer_km[first], n * sizeof(float));
+	for (int k = 0; k < n; k++) {
+		world->ring_order[first + k] = entries[k].body;
+		world->ring_inner_km[first + k] = entries[k].inner_km;
+		world->ring_outer_km[first + k] = outer[entries[k].body - first];
+	}
+	for (int b = 0; b * WORLD_RING_BLOCK < n; b++) {
+		int k = b * WORLD_RING_BLOCK;
+		float max = 0;
+		for (int j = k; j < n && j < k + WORLD_RING_BLOCK; j++) {
+			if (world->ring_outer_km[first + j] > max) max = world->ring_outer_km[first + j];
+		}
+		world->ring_block_inner_km[first + b] = world->ring_inner_km[first + k];
+		world->ring_block_outer_km[first + b] = max;
+	}
+	free(outer);
+	free(entries);
+}
+
+static void world_update_bounds(struct world* world)
+{
+	world->bounds_generation = sol_elements_generation;
+	float* reach_km = world->reach_km;
+	float* reach_px = world->reach_px;
+	for (int i = 0; i < world->n_bodies; i++) {
+		reach_km[i] = world->radius_km[i];
+		reach_px[i] = world->mock_radius[i];
+	}
+	// breadth-first, so satellites are done before their parents
+	for (int i = world->n_bodies - 1; i > 0; i--) {
+		struct celestial_body* body = &world->sol[i];
+		int p = body->parent;
+		float apoapsis_km = body->semi_major_axis_km * (1 + body->eccentricity);
+		float r = (apoapsis_km + reach_km[i]) * REACH_SLACK;
+		if (r > reach_km[p]) reach_km[p] = r;
+		if (reach_px[i] > reach_px[p]) reach_px[p] = reach_px[i];
+	}
+	for (int i = 0; i < world->n_bodies; i++) {
+		if (world->sol[i].n_satellites >= WORLD_RING_MIN) world_update_rings(world, i);
+	}
+}
+
+struct view {
+	float scale;
+	float cx, cy;
+	float hw, hh;
+};
+
+// screen positions of bodies [first;end); appends those whose systems may
+// be in view to visible[n...], and returns the new n
+static inline int visit(struct world* world, const struct view* v, int first, int end, int n)
+{
+	const float* kx = world->kepler.x;
+	const float* ky = world->kepler.y;
+	const float* radius_km = world->radius_km;
+	const float* mock_radius = world->mock_radius;
+	const float* reach_km = world->reach_km;
+	const float* reach_px = world->reach_px;
+	float* rx = world->render_x;
+	float* ry = world->render_y;
+	float* rr = world->render_radius;
+	int* visible = world->visible;
+	float scale = v->scale;
+	float cx = v->cx;
+	float cy = v->cy;
+	float hw = v->hw;
+	float hh = v->hh;
+	for (int i = first; i < end; i++) {
+		float x = (kx[i] - cx) * scale;
+		float y = (ky[i] - cy) * scale;
+		float actual_radius = radius_km[i] * scale;
+		rx[i] = x;
+		ry[i] = y;
+		rr[i] = actual_radius > mock_radius[i] ? actual_radius : mock_radius[i];
+		float reach = reach_km[i] * scale + reach_px[i];
+		// branchless; with many small bodies the test is a coin toss
+		visible[n] = i;
+		n += (fabsf(x) - reach <= hw) & (fabsf(y) - reach <= hh);
+	}
+	return n;
+}
+
+// the satellites of a visible parent whose annulus meets the view
+static int visit_rings(struct world* world, const struct view* v, int parent, int n)
+{
+	const struct celestial_body* p = &world->sol[parent];
+	int first = p->first_satellite;
+	int end = first + p->n_satellites;
+
+	// the view in km relative to the parent, widened by the satellites'
+	// largest mock radius
+	float margin = world->reach_px[parent];
+	float x0 = (-v->hw - margin - world->render_x[parent]) / v->scale;
+	float x1 = (v->hw + margin - world->render_x[parent]) / v->scale;
+	float y0 = (-v->hh - margin - world->render_y[parent]) / v->scale;
+	float y1 = (v->hh + margin - world->render_y[parent]) / v->scale;
+	float nx = x0 > 0 ? x0 : x1 < 0 ? -x1 : 0;
+	float ny = y0 > 0 ? y0 : y1 < 0 ? -y1 : 0;
+	float fx = fabsf(x0) > fabsf(x1) ? fabsf(x0) : fabsf(x1);
+	float fy = fabsf(y0) > fabsf(y1) ? fabsf(y0) : fabsf(y1);
+	float d_min = sqrtf(nx*nx + ny*ny);
+	float d_max = sqrtf(fx*fx + fy*fy);
+
+	const float* inner = world->ring_inner_km;
+	const float* outer = world->ring_outer_km;
+	const float* block_inner = &world->ring_block_inner_km[first];
+	const float* block_outer = &world->ring_block_outer_km[first];
+	int n_blocks = (end - first + WORLD_RING_BLOCK - 1) / WORLD_RING_BLOCK;
+
+	/* candidates are in annulus order, scattered over the array; when the
+	 * blocks let most of them through, a plain scan in array order is
+	 * cheaper than gathering them */
+	int n_passed = 0;
+	for (int b = 0; b < n_blocks; b++) {
+		if (block_inner[b] > d_max) break; // sorted; no later block reaches in
+		n_passed += block_outer[b] >= d_min;
+	}
+	if (n_passed * 4 > n_blocks) return visit(world, v, first, end, n);
+
+	int* candidates = world->ring_candidates;
+	int n_candidates = 0;
+	for (int b = 0; b < n_blocks; b++) {
+		if (block_inner[b] > d_max) break;
+		if (block_outer[b] < d_min) continue;
+		int k = first + b * WORLD_RING_BLOCK;
+		int block_end = k + WORLD_RING_BLOCK < end ? k + WORLD_RING_BLOCK : end;
+		for (int j = k; j < block_end; j++) {
+			candidates[n_candidates] = world->ring_order[j];
+			n_candidates += (inner[j] <= d_max) & (outer[j] >= d_min);
+		}
+	}
+	// array order, so visible stays sorted
+	qsort(candidates, n_candidates, sizeof(int), int_cmp);
+	for (int c = 0; c < n_candidates; c++) n = visit(world, v, candidates[c], candidates[c] + 1, n);
+	return n;
+}
+
+void world_update_screen_positions(struct world* world, float scale, float cx, float cy, float hw, float hh)
+{
+	if (world->bounds_generation != sol_elements_generation) world_update_bounds(world);
+
+	struct view v = {scale, cx, cy, hw, hh};
+	world->visible_frame++;
+	int n = 0;
+	if (world->n_bodies > 0) n = visit(world, &v, 0, 1, n);
+
+	/* visible doubles as the queue: the satellites of each visible body
+	 * are tested in turn, starting from the root. the array is
+	 * breadth-first, so they are appended in array order */
+	for (int k = 0; k < n; k++) {
+		int parent = world->visible[k];
+		const struct celestial_body* body = &world->sol[parent];
+		if (body->n_satellites == 0) continue;
+		world->visible_stamp[parent] = world->visible_frame;
+		if (body->n_satellites >= WORLD_RING_MIN) {
+			n = visit_rings(world, &v, parent, n);
+		} else {
+			n = visit(world, &v, body->first_satellite, body->first_satellite + body->n_satellites, n);
+		}
+	}
+	world->n_visible = n;
+}
+
+int world_find_body_at(struct world* world, float x, float y)
+{
+	const float* rx = world->render_x;
+	const float* ry = world->render_y;
+	const float* rr = world->render_radius;
+	for (int k = 0; k < world->n_visible; k++) {
+		int i = world->visible[k];
+		float dx = x - rx[i];
+		float dy = y - ry[i];
+		if (dx*dx + dy*dy < rr[i]*rr[i]) return i;
+	}
+	return -1;
+}
@@ -0,0 +1,94 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stdint.h>
+
+#include "sol.h"
+#include "kepler.h"
+#include "ephem.h"
+#include "nbody.h"
+
+/* the body store is split by access frequency: struct celestial_body (sol)
+ * holds cold elements and metadata, while everything touched per body per
+ * frame lives in the arrays below, all indexed by body id */
+
+struct world {
+	struct celestial_body* sol;
+	int n_bodies;
+	struct kepler_batch kepler; // absolute positions (km) are kepler.x/y
+	int use_ephem;
+	struct ephem ephem;
+	int use_nbody; // see world_set_nbody()
+	struct nbody nbody;
+	int64_t t60;
+
+	// copied from sol at world_init()
+	float* radius_km;
+	float* mock_radius;
+	uint8_t* renderer;
+
+	/* bounds of each body's system (itself, its satellites and their
+	 * orbits, recursively) around its position: reach_km from the elements
+	 * (apoapsis distances), plus reach_px for mock radii, which don't
+	 * scale. rebuilt when sol_elements_generation changes */
+	int bounds_generation;
+	float* reach_km;
+	float* reach_px;
+
+	/* for bodies with at least WORLD_RING_MIN satellites (the sun with a
+	 * minor body catalog): the satellites sorted by the inner radius of the
+	 * annulus their systems sweep around the parent, with that annulus.
+	 * stored at the satellites' own indices, so a parent's entries are
+	 * [first_satellite;first_satellite+n_satellites). per block of
+	 * WORLD_RING_BLOCK entries, the smallest inner and largest outer
+	 * radius, starting at first_satellite. a view far from the annulus of
+	 * most satellites skips them a block at a time */
+	int* ring_order;
+	float* ring_inner_km;
+	float* ring_outer_km;
+	float* ring_block_inner_km;
+	float* ring_block_outer_km;
+	int* ring_candidates; // scratch
+
+	/* screen position relative to the window centre (pixels), and radius.
+	 * only valid for visible bodies, the root, and those satellites of
+	 * visible bodies that their annulus didn't rule out */
+	float* render_x;
+	float* render_y;
+	float* render_radius;
+
+	// bodies whose system bounds intersect the view, in array order. those
+	// with satellites also have visible_stamp[i] == visible_frame
+	int n_visible;
+	int* visible;
+	int visible_frame;
+	int* visible_stamp;
+};
+
+#define WORLD_RING_MIN (256)
+#define WORLD_RING_BLOCK (64)
+
+void world_init(struct world* world, struct celestial_body* sol, int n_bodies);
+double world_t1(struct world* world);
+
+// switches between the analytic orbits and N-body integration; the N-body
+// state is seeded from the elements at the current t60
+void world_set_nbody(struct world* world, int enable);
+
+// kepler.x/y at world_t1()
+void world_update_positions(struct world* world);
+
+/* render_x/y/radius and the visible list for a view centred on (cx,cy) km
+ * extending hw,hh pixels each way from the centre (plus whatever margin is
+ * drawn around bodies and orbits). systems are culled top-down through the
+ * satellite tree, so one test rejects a planet with all its moons and
+ * nothing below it is touched; wide satellite lists are culled by annulus
+ * first (see ring_order) */
+void world_update_screen_positions(struct world* world, float scale, float cx, float cy, float hw, float hh);
+
+// body whose disc covers (x,y) (pixels relative to the window centre, y up);
+// bodies earlier in the array win. -1 if none. only visible bodies are
+// considered, so (x,y) must be in the view
+int world_find_body_at(struct world* world, float x, float y);
+
+#endif/*WORLD_H*/
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "a.h"
+#include "m.h"
+#include "sol.h"
+#include "world.h"
+#include "pool.h"
+
+/* world_bench: CPU side of a frame (positions, screen positions, picking)
+ * with the sol.c bodies plus n synthetic asteroids (default 100k), on
+ * n_threads threads (default 1), viewing height_km around the sun
+ * (default 3e8), or around the earth with -e.
+ * for cache misses, run it under e.g. "perf stat -e cache-misses" */
+
+#define FRAMES (200)
+
+int main(int argc, char** argv)
+{
+	int on_earth = argc > 1 && strcmp(argv[1], "-e") == 0;
+	if (on_earth) {
+		argc--;
+		argv++;
+	}
+	int n_minor = argc > 1 ? atoi(argv[1]) : 100000;
+	int n_threads = argc > 2 ? atoi(argv[2]) : 1;
+	float height_km = argc > 3 ? atof(argv[3]) : 3e8f;
+	pool_init(n_threads);
+
+	int n_bodies = 0;
+	struct celestial_body* planets = mksol(&n_bodies);
+	int first;
+	struct celestial_body* bodies = sol_insert_satellites(planets, &n_bodies, 0, n_minor, CBC_MINOR, &first);
+	free(planets);
+	srand(1);
+	for (int i = first; i < first + n_minor; i++) {
+		bodies[i].renderer = CBR_POINT;
+		bodies[i].radius_km = randf(0.5, 50);
+		bodies[i].mock_radius = 1;
+		celestial_body_set_elements(bodies, i, randf(1.8, 5.5) * AU_IN_KM, randf(0, 0.4), randf(0, TAU), randf(0, TAU));
+	}
+
+	struct world world;
+	world_init(&world, bodies, n_bodies);
+	int centre = 0;
+	for (int i = 0; on_earth && i < n_bodies; i++) {
+		if (strcmp(celestial_body_name(&bodies[i]), "earth") == 0) centre = i;
+	}
+
+	int width = 1920;
+	int height = 1080;
+	float scale = (float)height / height_km;
+	double t_positions = 0;
+	double t_screen = 0;
+	double t_pick = 0;
+	int n_picked = 0;
+	// the first screen pass builds the bounds; timed on its own
+	world_update_positions(&world);
+	double t_bounds = now();
+	world_update_screen_positions(&world, scale, world.kepler.x[centre], world.kepler.y[centre], width/2, height/2);
+	t_bounds = now() - t_bounds;
+	for (int f = 0; f < FRAMES; f++) {
+		world.t60 += 100000;
+		double t0 = now();
+		world_update_positions(&world);
+		double t1 = now();
+		world_update_screen_positions(&world, scale, world.kepler.x[centre], world.kepler.y[centre], width/2, height/2);
+		double t2 = now();
+		n_picked += world_find_body_at(&world, (f % width) - width/2, (f % height) - height/2) >= 0;
+		double t3 = now();
+		t_positions += t1 - t0;
+		t_screen += t2 - t1;
+		t_pick += t3 - t2;
+	}
+
+	printf("%d bodies (%d visible), %d threads, %d frames (%d picks hit)\n", n_bodies, world.n_visible, pool_n_threads(), FRAMES, n_picked);
+	printf("positions %.3f ms, screen %.3f ms, pick %.3f ms, total %.3f ms/frame\n",
+		t_positions * 1e3 / FRAMES,
+		t_screen * 1e3 / FRAMES,
+		t_pick * 1e3 / FRAMES,
+		(t_positions + t_screen + t_pick) * 1e3 / FRAMES);
+	printf("bounds %.3f ms (once)\n", t_bounds * 1e3);
+
+	pool_shutdown();
+
+	return EXIT_SUCCESS;
+}